@@ -1,50 +1,364 @@
 #pragma once
 
 #include <algorithm>
-#include <deque>
+#include <any>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <initializer_list>
+#include <iomanip>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace Pipeline {
 
   using std::cbegin;
   using std::cend;
-  using std::deque;
   using std::function;
   using std::initializer_list;
   using std::make_shared;
   using std::make_unique;
   using std::move;
+  using std::ostringstream;
   using std::shared_ptr;
   using std::size_t;
   using std::static_pointer_cast;
+  using std::string;
+  using std::to_string;
+  using std::type_index;
   using std::unique_ptr;
+  using std::unordered_map;
   using std::vector;
 
+  enum class ExplainFormat { Text, Json };
+
+  // Full sorts the whole input before yielding its first row. Incremental
+  // only does the work needed for each next row, so consuming k of n rows
+  // costs O(n + k log n). Stable keeps rows that compare equal in input
+  // order.
+  enum class SortMode { Full, Incremental, Stable };
+
+  enum class IndexKind { Sorted, Hash };
+
+  template <typename T> class Composer;
+
+  // A view over contiguous elements owned by someone else
+  template <typename T> class Span {
+    T *pointer;
+    size_t length;
+
+  public:
+    Span(T *pointer, const size_t &length) : pointer(pointer), length(length) {}
+    inline T *data() const { return pointer; }
+    inline size_t size() const { return length; }
+    inline bool empty() const { return length == 0; }
+    inline T *begin() const { return pointer; }
+    inline T *end() const { return pointer + length; }
+    inline T &operator[](const size_t &index) const { return pointer[index]; }
+  };
+
+  // Encodes the fields of a key into bytes whose memcmp order is the order
+  // of the fields, compared one after the other: booleans become one byte,
+  // integers become big-endian with the sign bit flipped, floating point
+  // numbers get their sign bit or all of their bits flipped, and strings
+  // escape their zero bytes and end with two zero bytes so that a prefix
+  // sorts first. A descending field is encoded inverted.
+  class SortKey {
+    string bytes;
+
+    template <typename U>
+    inline void append(U value, const size_t &size, const bool &descending) {
+      for (size_t shift = size; shift-- > 0;) {
+        auto byte = static_cast<unsigned char>(value >> (8 * shift));
+        bytes.push_back(static_cast<char>(descending ? ~byte : byte));
+      }
+    }
+
+  public:
+    template <typename V>
+    inline std::enable_if_t<std::is_integral_v<V>, SortKey &>
+    Add(const V &value, const bool &descending = false) {
+      if constexpr (std::is_same_v<V, bool>)
+        append(static_cast<unsigned char>(value), 1, descending);
+      else {
+        using U = std::make_unsigned_t<V>;
+        U bits = static_cast<U>(value);
+        if constexpr (std::is_signed_v<V>)
+          bits ^= U(1) << (8 * sizeof(V) - 1);
+        append(bits, sizeof(V), descending);
+      }
+      return *this;
+    }
+    template <typename V>
+    inline std::enable_if_t<std::is_floating_point_v<V>, SortKey &>
+    Add(V value, const bool &descending = false) {
+      static_assert(sizeof(V) == 4 || sizeof(V) == 8,
+                    "only 32 and 64 bit floating point keys are supported");
+      using U = std::conditional_t<sizeof(V) == 4, uint32_t, uint64_t>;
+      if (value == 0)
+        value = 0; // -0.0 and 0.0 compare equal
+      U bits;
+      std::memcpy(&bits, &value, sizeof(V));
+      U sign = U(1) << (8 * sizeof(V) - 1);
+      bits = bits & sign ? ~bits : bits | sign;
+      append(bits, sizeof(V), descending);
+      return *this;
+    }
+    inline SortKey &Add(const string &value, const bool &descending = false) {
+      auto put = [&](const unsigned char &byte) {
+        bytes.push_back(static_cast<char>(descending ? ~byte : byte));
+      };
+      for (unsigned char byte : value) {
+        put(byte);
+        if (byte == 0)
+          put(0xFF);
+      }
+      put(0);
+      put(0);
+      return *this;
+    }
+    inline SortKey &Add(const char *value, const bool &descending = false) {
+      return Add(string(value), descending);
+    }
+    inline void clear() { bytes.clear(); }
+    inline const string &str() const { return bytes; }
+  };
+
+  // Mixes word into hash, so that the order of the words matters
+  inline uint64_t hashCombine(uint64_t hash, const uint64_t &word) {
+    hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+    return hash ^ (hash >> 31);
+  }
+  // A fast non-cryptographic hash of length bytes, read 32 at a time into
+  // four independent lanes
+  inline uint64_t hashBytes(const void *data, const size_t &length,
+                            const uint64_t &seed = 0) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    uint64_t lanes[4] = {seed, seed ^ 0x9e3779b97f4a7c15ull,
+                         seed ^ 0x94d049bb133111ebull,
+                         seed ^ 0xd6e8feb86659fd93ull};
+    size_t index = 0;
+    for (uint64_t word; index + 32 <= length; index += 32)
+      for (int lane = 0; lane < 4; ++lane) {
+        std::memcpy(&word, bytes + index + 8 * lane, 8);
+        lanes[lane] = hashCombine(lanes[lane], word);
+      }
+    uint64_t hash = length;
+    for (auto lane : lanes)
+      hash = hashCombine(hash, lane);
+    for (uint64_t word; index < length; index += 8) {
+      word = 0;
+      std::memcpy(&word, bytes + index, std::min<size_t>(8, length - index));
+      hash = hashCombine(hash, word);
+    }
+    return hashCombine(hash, length);
+  }
+
+  template <typename V, typename = void>
+  struct Hashable : std::false_type {};
+  template <typename V>
+  struct Hashable<
+      V, std::void_t<decltype(std::hash<V>()(std::declval<const V &>()))>>
+      : std::true_type {};
+
+  // Whether hashValue can hash a V, known when a type is to be cached
+  template <typename V>
+  constexpr bool HashableValue =
+      Hashable<V>::value || std::has_unique_object_representations_v<V>;
+
+  // Hashes a value with std::hash, or else by its bytes when every byte is
+  // part of its value
+  template <typename V> inline uint64_t hashValue(const V &value) {
+    if constexpr (Hashable<V>::value)
+      return std::hash<V>()(value);
+    else if constexpr (std::has_unique_object_representations_v<V>)
+      return hashBytes(&value, sizeof(V));
+    else
+      throw std::invalid_argument(string("cannot hash a ") +
+                                  typeid(V).name());
+  }
+
+  // A value shared by every copy of the handle, and so by every copy of the
+  // stages that captured it. Changing it between runs changes the behaviour
+  // of the pipeline without rebuilding it.
+  template <typename V> class Parameter {
+    template <typename> friend class Composer;
+
+    shared_ptr<V> value;
+
+    Parameter(shared_ptr<V> value) : value(move(value)) {}
+
+  public:
+    Parameter(const V &value = V()) : value(make_shared<V>(value)) {}
+    inline const V &operator*() const { return *value; }
+    inline const V *operator->() const { return value.get(); }
+    inline const V &Get() const { return *value; }
+    inline void Set(const V &value) { *this->value = value; }
+  };
+
+  // Assigns the value held by from to into when it is of one of the
+  // arithmetic types Sources, e.g. an int literal to a size_t parameter;
+  // returns false when from holds none of them. A number that an integral
+  // into cannot hold exactly is refused rather than wrapped or truncated.
+  template <typename R, typename S, typename... Sources>
+  inline bool assignArithmetic(const std::any &from, R &into,
+                               const string &name) {
+    if (auto value = std::any_cast<S>(&from)) {
+      if constexpr (std::is_integral_v<R> && std::is_floating_point_v<S>) {
+        S bound = std::ldexp(S(1), std::numeric_limits<R>::digits);
+        if (!(*value >= (std::is_signed_v<R> ? -bound : S(0)) &&
+              *value < bound && std::trunc(*value) == *value))
+          throw std::out_of_range("parameter " + name + " cannot hold " +
+                                  to_string(*value));
+      }
+      R converted = static_cast<R>(*value);
+      if constexpr (std::is_integral_v<R> && std::is_integral_v<S>) {
+        bool negative = false, convertedNegative = false;
+        if constexpr (std::is_signed_v<S>)
+          negative = *value < 0;
+        if constexpr (std::is_signed_v<R>)
+          convertedNegative = converted < 0;
+        if (static_cast<S>(converted) != *value ||
+            negative != convertedNegative)
+          throw std::out_of_range("parameter " + name + " cannot hold " +
+                                  to_string(*value));
+      }
+      into = converted;
+      return true;
+    }
+    if constexpr (sizeof...(Sources) > 0)
+      return assignArithmetic<R, Sources...>(from, into, name);
+    else
+      return false;
+  }
+
+  template <typename T> class Functor;
   template <typename T> class Select;
+  template <typename T> class SelectMemo;
+  template <typename T> class SelectBatch;
   template <typename T> class Take;
   template <typename T> class Where;
   template <typename T> class OrderBy;
-  template <typename T> class Composer;
-  template <typename T> class Iterate;
+  template <typename T> class OrderByKey;
+  template <typename T> class OrderByNormalized;
+  template <typename T, typename C = vector<T>> class Iterate;
+  template <typename T> class MergeSorted;
+  template <typename T> class Generate;
+  template <typename T> class Prefetch;
+  template <typename T> class MultiQuery;
+  template <typename T, typename C>
+  inline shared_ptr<Functor<T>> makeSource(const C &values);
+
+  // The order in which a stage yields its rows: sorted by comparer, or in
+  // no known order when comparer is null. Two orderings are known to agree
+  // when their comparers are of the same stateless type or are the same
+  // function.
+  template <typename T> struct Ordering {
+    const function<bool(const T &, const T &)> *comparer = nullptr;
+    bool stateless = false;
+
+    inline bool agrees(const Ordering<T> &other) const {
+      if (comparer == nullptr || other.comparer == nullptr ||
+          comparer->target_type() != other.comparer->target_type())
+        return false;
+      if (stateless && other.stateless)
+        return true;
+      using Pointer = bool (*)(const T &, const T &);
+      auto first = comparer->template target<Pointer>();
+      auto second = other.comparer->template target<Pointer>();
+      return first != nullptr && second != nullptr && *first == *second;
+    }
+  };
 
   template <typename T> class Functor {
     friend Select<T>;
+    friend SelectMemo<T>;
+    friend SelectBatch<T>;
     friend Take<T>;
     friend Where<T>;
     friend OrderBy<T>;
+    friend OrderByKey<T>;
+    friend OrderByNormalized<T>;
     friend Composer<T>;
-    friend Iterate<T>;
+    template <typename, typename> friend class Iterate;
+    friend MergeSorted<T>;
+    friend Generate<T>;
+    friend Prefetch<T>;
+    friend MultiQuery<T>;
+    template <typename U, typename C>
+    friend shared_ptr<Functor<U>> makeSource(const C &values);
 
   protected:
+    // rows handed downstream since the last reset, reported by Explain()
+    size_t produced = 0;
+    // shared by a stage and its deep copies, so that the forks of a
+    // pipeline can tell which of their stages they have in common
+    size_t lineage = fresh();
+
+    static size_t fresh() {
+      static std::atomic<size_t> counter(0);
+      return ++counter;
+    }
+
     virtual shared_ptr<Functor<T>> deepCopy() const = 0;
     virtual void
     setPreviousFunction(shared_ptr<Functor<T>> previousFunction) = 0;
     virtual shared_ptr<Functor<T>> getPreviousFunction() const = 0;
-    virtual inline unique_ptr<T> operator()(const bool &reset) = 0;
+    // prepares this stage and everything upstream of it for a new run
+    virtual void open() = 0;
+    // yields the next row, or nullptr once the stage is exhausted
+    virtual inline unique_ptr<T> next() = 0;
+    // releases the per-run state of this stage and everything upstream
+    virtual void close() = 0;
+    virtual string describe() const = 0;
+    // what the stage does, leaving out how its last run went, for
+    // fingerprinting the pipeline
+    virtual string signature() const { return describe(); }
+    // the type of the function the stage was given, which tells apart
+    // stages given different lambdas or function objects
+    virtual string callable() const { return ""; }
+    // estimated output rows and per-stage cost for a given number of input rows
+    virtual double estimate(const double &rows) const { return rows; }
+    virtual double cost(const double &rows) const { return rows; }
+    // appends the leaf stages of this node, from output to input
+    virtual void flatten(vector<const Functor<T> *> &stages) const {
+      stages.push_back(this);
+    }
+    virtual Ordering<T> ordering() const { return {}; }
+    // A stage that yields input row i as output row i turns the number of
+    // input rows into the number of output rows and maps a single row as
+    // next() would; any other stage returns false
+    virtual bool mapIndex(size_t &) const { return false; }
+    virtual void mapValue(T &) const {}
+    // A stage whose output row count follows from its input row count alone
+    // turns one into the other, never raising it; any other stage returns
+    // false
+    virtual bool mapCount(size_t &) const { return false; }
+    // Whether the stage, once it yielded nullptr because its input did,
+    // goes on to yield what its input yields when pulled again, so that a
+    // run can be paused at the end of each block of its input
+    virtual bool resumable() const { return false; }
 
   public:
     virtual ~Functor() = default;
@@ -62,16 +376,30 @@ namespace Pipeline {
     }
     shared_ptr<Functor<T>> deepCopy() const {
       auto copy = make_shared<Select<T>>(updater);
+      copy->lineage = this->lineage;
       if (previousFunction)
         copy->previousFunction = previousFunction->deepCopy();
       return copy;
     }
-    inline unique_ptr<T> operator()(const bool &reset) {
-      auto result = previousFunction->operator()(reset);
-      if (result != nullptr)
-        result = make_unique<T>(updater(*result));
+    void open() {
+      previousFunction->open();
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      auto result = previousFunction->next();
+      if (result != nullptr) {
+        *result = updater(*result);
+        ++this->produced;
+      }
       return result;
     }
+    void close() { previousFunction->close(); }
+    string describe() const { return "Select"; }
+    bool resumable() const { return true; }
+    string callable() const { return updater.target_type().name(); }
+    bool mapIndex(size_t &) const { return true; }
+    void mapValue(T &value) const { value = updater(value); }
+    bool mapCount(size_t &) const { return true; }
 
   public:
     Select(const function<T(const T &)> &updater)
@@ -91,6 +419,208 @@ namespace Pipeline {
     Select<T> &operator=(Select<T> &&other) = default;
   };
 
+  // A Select for pure but costly updaters over repetitive input: results
+  // are cached by input value in a table of up to capacity entries, which
+  // keeps its contents between runs and evicts in CLOCK order. T must be
+  // hashable with std::hash and comparable with ==.
+  template <typename T> class SelectMemo : public Functor<T> {
+    struct Slot {
+      T key, value;
+      // set on every hit, cleared as the clock hand passes
+      bool referenced;
+    };
+
+    shared_ptr<Functor<T>> previousFunction;
+    function<T(const T &)> updater;
+    size_t capacity;
+    vector<Slot> slots;
+    unordered_map<T, size_t> index;
+    size_t hand, hits;
+
+    void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
+      this->previousFunction = previousFunction;
+    }
+    shared_ptr<Functor<T>> getPreviousFunction() const {
+      return previousFunction;
+    }
+    shared_ptr<Functor<T>> deepCopy() const {
+      auto copy = make_shared<SelectMemo<T>>(updater, capacity);
+      copy->lineage = this->lineage;
+      if (previousFunction)
+        copy->previousFunction = previousFunction->deepCopy();
+      return copy;
+    }
+    inline void remember(const T &key, const T &value) {
+      if (slots.size() < capacity) {
+        index.emplace(key, slots.size());
+        slots.push_back({key, value, false});
+        return;
+      }
+      while (slots[hand].referenced) {
+        slots[hand].referenced = false;
+        hand = (hand + 1) % capacity;
+      }
+      auto &slot = slots[hand];
+      index.erase(slot.key);
+      slot.key = key;
+      slot.value = value;
+      index.emplace(key, hand);
+      hand = (hand + 1) % capacity;
+    }
+    void open() {
+      previousFunction->open();
+      this->produced = 0;
+      hits = 0;
+    }
+    inline unique_ptr<T> next() {
+      auto result = previousFunction->next();
+      if (result == nullptr)
+        return result;
+      auto found = index.find(*result);
+      if (found != index.end()) {
+        auto &slot = slots[found->second];
+        slot.referenced = true;
+        *result = slot.value;
+        ++hits;
+      } else {
+        T value = updater(*result);
+        if (capacity)
+          remember(*result, value);
+        *result = move(value);
+      }
+      ++this->produced;
+      return result;
+    }
+    void close() { previousFunction->close(); }
+    string describe() const {
+      return "SelectMemo(" + to_string(capacity) + ", " + to_string(hits) +
+             " hits)";
+    }
+    string signature() const {
+      return "SelectMemo(" + to_string(capacity) + ")";
+    }
+    bool resumable() const { return true; }
+    string callable() const { return updater.target_type().name(); }
+    bool mapIndex(size_t &) const { return true; }
+    void mapValue(T &value) const {
+      auto found = index.find(value);
+      value = found != index.end() ? slots[found->second].value
+                                   : updater(value);
+    }
+    bool mapCount(size_t &) const { return true; }
+
+  public:
+    SelectMemo(const function<T(const T &)> &updater, const size_t &capacity)
+        : previousFunction(nullptr), updater(updater), capacity(capacity),
+          hand(0), hits(0) {}
+    // A copy starts with an empty cache
+    SelectMemo(const SelectMemo<T> &other)
+        : previousFunction(other.previousFunction
+                               ? other.previousFunction->deepCopy()
+                               : nullptr),
+          updater(other.updater), capacity(other.capacity), hand(0),
+          hits(0) {}
+    SelectMemo<T> &operator=(const SelectMemo<T> &other) {
+      updater = other.updater;
+      capacity = other.capacity;
+      slots.clear();
+      index.clear();
+      hand = hits = 0;
+      previousFunction =
+          other.previousFunction ? other.previousFunction->deepCopy() : nullptr;
+      return *this;
+    }
+    SelectMemo(SelectMemo<T> &&other) = default;
+    SelectMemo<T> &operator=(SelectMemo<T> &&other) = default;
+  };
+
+  // A Select whose updater maps a block of up to size rows at a time, for
+  // transforms that are cheaper in bulk. The output span has as many rows
+  // as the input and starts out as a copy of it. Rows are read a block
+  // ahead of the ones handed downstream.
+  template <typename T> class SelectBatch : public Functor<T> {
+    shared_ptr<Functor<T>> previousFunction;
+    function<void(Span<const T>, Span<T>)> updater;
+    size_t size;
+    // kept between runs so that their capacity is reused
+    vector<T> inputs, outputs;
+    size_t position;
+
+    void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
+      this->previousFunction = previousFunction;
+    }
+    shared_ptr<Functor<T>> getPreviousFunction() const {
+      return previousFunction;
+    }
+    shared_ptr<Functor<T>> deepCopy() const {
+      auto copy = make_shared<SelectBatch<T>>(updater, size);
+      copy->lineage = this->lineage;
+      if (previousFunction)
+        copy->previousFunction = previousFunction->deepCopy();
+      return copy;
+    }
+    void open() {
+      previousFunction->open();
+      outputs.clear();
+      position = 0;
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (position == outputs.size()) {
+        inputs.clear();
+        while (inputs.size() < size)
+          if (auto result = previousFunction->next())
+            inputs.emplace_back(move(*result));
+          else
+            break;
+        if (inputs.empty())
+          return nullptr;
+        outputs = inputs;
+        updater(Span<const T>(inputs.data(), inputs.size()),
+                Span<T>(outputs.data(), outputs.size()));
+        position = 0;
+      }
+      ++this->produced;
+      return make_unique<T>(move(outputs[position++]));
+    }
+    void close() {
+      previousFunction->close();
+      inputs.clear();
+      outputs.clear();
+      position = 0;
+    }
+    string describe() const { return "SelectBatch(" + to_string(size) + ")"; }
+    string callable() const { return updater.target_type().name(); }
+    bool mapIndex(size_t &) const { return true; }
+    void mapValue(T &value) const {
+      T input = value;
+      updater(Span<const T>(&input, 1), Span<T>(&value, 1));
+    }
+    bool mapCount(size_t &) const { return true; }
+
+  public:
+    SelectBatch(const function<void(Span<const T>, Span<T>)> &updater,
+                const size_t &size = 1024)
+        : previousFunction(nullptr), updater(updater),
+          size(std::max<size_t>(size, 1)), position(0) {}
+    SelectBatch(const SelectBatch<T> &other)
+        : previousFunction(other.previousFunction
+                               ? other.previousFunction->deepCopy()
+                               : nullptr),
+          updater(other.updater), size(other.size), position(0) {}
+    SelectBatch<T> &operator=(const SelectBatch<T> &other) {
+      updater = other.updater;
+      size = other.size;
+      outputs.clear();
+      position = 0;
+      previousFunction =
+          other.previousFunction ? other.previousFunction->deepCopy() : nullptr;
+      return *this;
+    }
+    SelectBatch(SelectBatch<T> &&other) = default;
+    SelectBatch<T> &operator=(SelectBatch<T> &&other) = default;
+  };
+
   template <typename T> class Where : public Functor<T> {
     shared_ptr<Functor<T>> previousFunction;
     function<bool(const T &)> checker;
@@ -103,19 +633,33 @@ namespace Pipeline {
     }
     shared_ptr<Functor<T>> deepCopy() const {
       auto copy = make_shared<Where<T>>(checker);
+      copy->lineage = this->lineage;
       if (previousFunction)
         copy->previousFunction = previousFunction->deepCopy();
       return copy;
     }
-    inline unique_ptr<T> operator()(const bool &reset) {
+    void open() {
+      previousFunction->open();
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
       unique_ptr<T> result;
-      bool needReset = reset;
-      do {
-        result = previousFunction->operator()(needReset);
-        needReset = false;
-      } while (result != nullptr && !checker(*result));
+      do
+        result = previousFunction->next();
+      while (result != nullptr && !checker(*result));
+      if (result != nullptr)
+        ++this->produced;
       return result;
     }
+    void close() { previousFunction->close(); }
+    string describe() const { return "Where"; }
+    bool resumable() const { return true; }
+    string callable() const { return checker.target_type().name(); }
+    Ordering<T> ordering() const {
+      return previousFunction ? previousFunction->ordering() : Ordering<T>();
+    }
+    // without statistics a filter is assumed to keep half of its input
+    double estimate(const double &rows) const { return rows * 0.5; }
 
   public:
     Where(const function<bool(const T &)> &checker)
@@ -138,7 +682,7 @@ namespace Pipeline {
   template <typename T> class Take : public Functor<T> {
     shared_ptr<Functor<T>> previousFunction;
     size_t remaining;
-    const size_t _capacity;
+    Parameter<size_t> capacity;
 
     void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
       this->previousFunction = previousFunction;
@@ -147,33 +691,57 @@ namespace Pipeline {
       return previousFunction;
     }
     shared_ptr<Functor<T>> deepCopy() const {
-      auto copy = make_shared<Take<T>>(_capacity);
+      auto copy = make_shared<Take<T>>(capacity);
+      copy->lineage = this->lineage;
       if (previousFunction)
         copy->previousFunction = previousFunction->deepCopy();
       return copy;
     }
-    inline unique_ptr<T> operator()(const bool &reset) {
-      if (reset)
-        remaining = _capacity;
+    void open() {
+      previousFunction->open();
+      remaining = *capacity;
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
       if (!remaining)
         return nullptr;
-      --remaining;
-      auto result = previousFunction->operator()(reset);
-      if (result == nullptr)
-        remaining = 0;
+      auto result = previousFunction->next();
+      if (result != nullptr) {
+        --remaining;
+        ++this->produced;
+      }
       return result;
     }
+    void close() { previousFunction->close(); }
+    string describe() const { return "Take(" + to_string(*capacity) + ")"; }
+    bool resumable() const { return true; }
+    Ordering<T> ordering() const {
+      return previousFunction ? previousFunction->ordering() : Ordering<T>();
+    }
+    double estimate(const double &rows) const {
+      return std::min(rows, static_cast<double>(*capacity));
+    }
+    double cost(const double &rows) const { return estimate(rows); }
+    bool mapIndex(size_t &length) const {
+      length = std::min(length, *capacity);
+      return true;
+    }
+    bool mapCount(size_t &count) const { return mapIndex(count); }
 
   public:
     Take(const size_t &capacity)
-        : previousFunction(nullptr), remaining(capacity), _capacity(capacity) {}
+        : previousFunction(nullptr), remaining(capacity), capacity(capacity) {}
+    // The count is read from capacity at the start of every run
+    Take(const Parameter<size_t> &capacity)
+        : previousFunction(nullptr), remaining(*capacity), capacity(capacity) {}
     Take(const Take<T> &other)
         : previousFunction(other.previousFunction
                                ? other.previousFunction->deepCopy()
                                : nullptr),
-          remaining(other._capacity), _capacity(other._capacity) {}
+          remaining(*other.capacity), capacity(other.capacity) {}
     Take<T> &operator=(const Take<T> &other) {
-      remaining = _capacity = other._capacity;
+      capacity = other.capacity;
+      remaining = *capacity;
       previousFunction =
           other.previousFunction ? other.previousFunction->deepCopy() : nullptr;
       return *this;
@@ -185,8 +753,386 @@ namespace Pipeline {
   template <typename T> class OrderBy : public Functor<T> {
     shared_ptr<Functor<T>> previousFunction;
     function<bool(const T &, const T &)> comparer;
-    bool processed;
-    deque<unique_ptr<T>> results;
+    // whether comparer was built from an empty function object
+    bool stateless;
+    SortMode mode;
+    size_t threads;
+    bool processed, passthrough;
+    // kept between runs so that their capacity is reused
+    vector<unique_ptr<T>> results, scratch;
+    vector<T> values;
+    vector<size_t> runs;
+    size_t position;
+    // unsorted ranges of results in incremental mode, the leftmost on top;
+    // rows at or after position that are in none of them are in place
+    vector<std::pair<size_t, size_t>> pending;
+
+    inline bool less(const unique_ptr<T> &first,
+                     const unique_ptr<T> &second) const {
+      return comparer(*first, *second);
+    }
+    // Compare-exchanges low[index] with high[index] for every index below
+    // count, leaving the smaller value in low when ascending
+    static inline void exchange(T *low, T *high, const size_t &count,
+                                const bool &ascending) {
+      size_t index = 0;
+      [[maybe_unused]] auto lanes = [&](const size_t &width, auto load,
+                                        auto store, auto min, auto max) {
+        for (; index + width <= count; index += width) {
+          auto first = load(low + index), second = load(high + index);
+          auto smaller = min(first, second), larger = max(first, second);
+          store(low + index, ascending ? smaller : larger);
+          store(high + index, ascending ? larger : smaller);
+        }
+      };
+#if defined(__AVX2__)
+      constexpr bool integral = std::is_integral_v<T>,
+                     isSigned = std::is_signed_v<T>;
+      [[maybe_unused]] auto load = [](const T *from) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from));
+      };
+      [[maybe_unused]] auto store = [](T *to, const __m256i &from) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(to), from);
+      };
+      if constexpr (integral && sizeof(T) == 4 && isSigned)
+        lanes(
+            8, load, store,
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_min_epi32(first, second);
+            },
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_max_epi32(first, second);
+            });
+      else if constexpr (integral && sizeof(T) == 4)
+        lanes(
+            8, load, store,
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_min_epu32(first, second);
+            },
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_max_epu32(first, second);
+            });
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+      else if constexpr (integral && sizeof(T) == 8 && isSigned)
+        lanes(
+            4, load, store,
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_min_epi64(first, second);
+            },
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_max_epi64(first, second);
+            });
+      else if constexpr (integral && sizeof(T) == 8)
+        lanes(
+            4, load, store,
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_min_epu64(first, second);
+            },
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_max_epu64(first, second);
+            });
+#else
+      else if constexpr (integral && sizeof(T) == 8 && isSigned)
+        lanes(
+            4, load, store,
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_blendv_epi8(first, second,
+                                        _mm256_cmpgt_epi64(first, second));
+            },
+            [](const __m256i &first, const __m256i &second) {
+              return _mm256_blendv_epi8(second, first,
+                                        _mm256_cmpgt_epi64(first, second));
+            });
+#endif
+      else if constexpr (std::is_same_v<T, float>)
+        lanes(
+            8, [](const float *from) { return _mm256_loadu_ps(from); },
+            [](float *to, const __m256 &from) { _mm256_storeu_ps(to, from); },
+            [](const __m256 &first, const __m256 &second) {
+              return _mm256_min_ps(first, second);
+            },
+            [](const __m256 &first, const __m256 &second) {
+              return _mm256_max_ps(first, second);
+            });
+      else if constexpr (std::is_same_v<T, double>)
+        lanes(
+            4, [](const double *from) { return _mm256_loadu_pd(from); },
+            [](double *to, const __m256d &from) { _mm256_storeu_pd(to, from); },
+            [](const __m256d &first, const __m256d &second) {
+              return _mm256_min_pd(first, second);
+            },
+            [](const __m256d &first, const __m256d &second) {
+              return _mm256_max_pd(first, second);
+            });
+#endif
+      for (; index < count; ++index) {
+        T first = low[index], second = high[index];
+        bool swapped = (second < first) == ascending;
+        low[index] = swapped ? second : first;
+        high[index] = swapped ? first : second;
+      }
+    }
+    // Moves the sorted runs first[0, firstCount) and second[0, secondCount)
+    // into one sorted run of to, choosing each value without a branch
+    static inline void mergeValues(const T *first, const size_t &firstCount,
+                                   const T *second, const size_t &secondCount,
+                                   T *to) {
+      size_t left = 0, right = 0;
+      while (left < firstCount && right < secondCount) {
+        bool fromSecond = second[right] < first[left];
+        *to++ = fromSecond ? second[right] : first[left];
+        right += fromSecond;
+        left += !fromSecond;
+      }
+      to = std::copy(first + left, first + firstCount, to);
+      std::copy(second + right, second + secondCount, to);
+    }
+    // Sorts count <= 64 values. Small inputs are insertion sorted; larger
+    // ones are padded with the largest value of T into an 8x8 matrix whose
+    // columns are sorted together by an 8-input network, one comparator
+    // being one vector min/max over a row, and the eight sorted columns
+    // are then merged.
+    static inline void network(T *values, const size_t &count) {
+      if (count <= 16) {
+        for (size_t index = 1; index < count; ++index) {
+          T value = values[index];
+          size_t slot = index;
+          for (; slot > 0 && value < values[slot - 1]; --slot)
+            values[slot] = values[slot - 1];
+          values[slot] = value;
+        }
+        return;
+      }
+      static constexpr std::pair<size_t, size_t> comparators[] = {
+          {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6},
+          {3, 7}, {0, 1}, {2, 3}, {4, 5}, {6, 7}, {2, 4}, {3, 5},
+          {1, 4}, {3, 6}, {1, 2}, {3, 4}, {5, 6}};
+      T matrix[64], runs[64];
+      std::copy(values, values + count, matrix);
+      std::fill(matrix + count, matrix + 64,
+                std::numeric_limits<T>::has_infinity
+                    ? std::numeric_limits<T>::infinity()
+                    : std::numeric_limits<T>::max());
+      for (auto &[low, high] : comparators)
+        exchange(matrix + 8 * low, matrix + 8 * high, 8, true);
+      for (size_t row = 0; row < 8; ++row)
+        for (size_t column = 0; column < 8; ++column)
+          runs[8 * column + row] = matrix[8 * row + column];
+      T *from = runs, *to = matrix;
+      for (size_t width = 8; width < 64; width *= 2) {
+        for (size_t low = 0; low < 64; low += 2 * width)
+          mergeValues(from + low, width, from + low + width, width, to + low);
+        std::swap(from, to);
+      }
+      std::copy(from, from + count, values);
+    }
+    // Quicksort on plain values whose partitions of up to 64 values are
+    // finished by the sorting network
+    static inline void sortValues(T *values, size_t count, size_t depth) {
+      while (count > 64) {
+        if (depth-- == 0) {
+          std::sort(values, values + count);
+          return;
+        }
+        T first = values[0], middle = values[count / 2],
+          last = values[count - 1];
+        T pivot = std::max(std::min(first, middle),
+                           std::min(std::max(first, middle), last));
+        ptrdiff_t left = -1, right = count;
+        while (true) {
+          do
+            ++left;
+          while (values[left] < pivot);
+          do
+            --right;
+          while (pivot < values[right]);
+          if (left >= right)
+            break;
+          std::swap(values[left], values[right]);
+        }
+        size_t split = right + 1;
+        if (split < count - split) {
+          sortValues(values, split, depth);
+          values += split;
+          count -= split;
+        } else {
+          sortValues(values + split, count - split, depth);
+          count = split;
+        }
+      }
+      if (count > 1)
+        network(values, count);
+    }
+    // With std::less or std::greater over arithmetic rows, the rows are
+    // sorted as plain values without calling the comparer
+    inline bool sortArithmetic() {
+      if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) {
+        bool ascending = comparer.template target<std::less<T>>() ||
+                         comparer.template target<std::less<>>();
+        if (!ascending && !comparer.template target<std::greater<T>>() &&
+            !comparer.template target<std::greater<>>())
+          return false;
+        values.resize(results.size());
+        for (size_t index = 0; index < results.size(); ++index)
+          values[index] = *results[index];
+        if (ascending ? std::is_sorted(values.begin(), values.end())
+                      : std::is_sorted(values.rbegin(), values.rend()))
+          return true;
+        sortValues(values.data(), values.size(),
+                   2 * static_cast<size_t>(std::log2(values.size() + 1)));
+        if (!ascending)
+          std::reverse(values.begin(), values.end());
+        for (size_t index = 0; index < results.size(); ++index)
+          *results[index] = values[index];
+        return true;
+      } else
+        return false;
+    }
+    // Moves the sorted ranges [begin, middle) and [middle, end) of from into
+    // one sorted range of to, taking from the left range on ties
+    inline void merge(vector<unique_ptr<T>> &from, vector<unique_ptr<T>> &to,
+                      const size_t &begin, const size_t &middle,
+                      const size_t &end) const {
+      size_t left = begin, right = middle, target = begin;
+      while (left < middle && right < end)
+        to[target++] = move(less(from[right], from[left]) ? from[right++]
+                                                          : from[left++]);
+      while (left < middle)
+        to[target++] = move(from[left++]);
+      while (right < end)
+        to[target++] = move(from[right++]);
+    }
+    // Records where each ascending run of results starts, followed by the
+    // number of rows, and returns how many runs there are
+    inline size_t countRuns() {
+      runs.assign(1, 0);
+      for (size_t index = 1; index < results.size(); ++index)
+        if (less(results[index], results[index - 1]))
+          runs.push_back(index);
+      runs.push_back(results.size());
+      return runs.size() - 1;
+    }
+    // Merges neighbouring runs found by countRuns until one is left
+    inline void mergeRuns() {
+      scratch.resize(results.size());
+      auto *from = &results, *to = &scratch;
+      while (runs.size() > 2) {
+        size_t kept = 0;
+        for (size_t index = 0; index + 1 < runs.size(); index += 2) {
+          merge(*from, *to, runs[index], runs[index + 1],
+                runs[std::min(index + 2, runs.size() - 1)]);
+          runs[kept++] = runs[index];
+        }
+        runs[kept++] = runs.back();
+        runs.resize(kept);
+        std::swap(from, to);
+      }
+      if (from != &results)
+        results.swap(scratch);
+    }
+    // Stable bottom-up merge sort of results[begin, end), using the same
+    // range of scratch
+    inline void mergeSort(const size_t &begin, const size_t &end) {
+      const size_t run = 32;
+      for (size_t low = begin; low < end; low += run)
+        for (size_t index = low + 1; index < std::min(low + run, end);
+             ++index)
+          for (size_t slot = index;
+               slot > low && less(results[slot], results[slot - 1]); --slot)
+            swap(results[slot], results[slot - 1]);
+      auto *from = &results, *to = &scratch;
+      for (size_t width = run; width < end - begin; width *= 2) {
+        for (size_t low = begin; low < end; low += 2 * width)
+          merge(*from, *to, low, std::min(low + width, end),
+                std::min(low + 2 * width, end));
+        std::swap(from, to);
+      }
+      if (from != &results)
+        std::move(scratch.begin() + begin, scratch.begin() + end,
+                  results.begin() + begin);
+    }
+    // Sorts contiguous chunks on separate threads, then merges neighbouring
+    // chunks level by level, each level's merges also running in parallel.
+    // An exception thrown by the comparer on any thread is rethrown once
+    // every thread of its level is joined.
+    inline void stableSort() {
+      scratch.resize(results.size());
+      size_t parts = std::max<size_t>(
+          1, std::min(threads, results.size() / 4096));
+      vector<size_t> bounds;
+      for (size_t part = 0; part <= parts; ++part)
+        bounds.push_back(results.size() * part / parts);
+      auto parallel = [](const size_t &tasks, auto &&task) {
+        vector<std::exception_ptr> errors(tasks);
+        auto run = [&errors, &task](const size_t &index) {
+          try {
+            task(index);
+          } catch (...) {
+            errors[index] = std::current_exception();
+          }
+        };
+        vector<std::thread> workers;
+        for (size_t index = 1; index < tasks; ++index)
+          workers.emplace_back(run, index);
+        run(0);
+        for (auto &worker : workers)
+          worker.join();
+        for (auto &error : errors)
+          if (error)
+            std::rethrow_exception(error);
+      };
+      parallel(parts, [&](const size_t &part) {
+        mergeSort(bounds[part], bounds[part + 1]);
+      });
+      for (size_t step = 1; step < parts; step *= 2)
+        parallel((parts + 2 * step - 1) / (2 * step), [&](const size_t &pair) {
+          size_t low = pair * 2 * step;
+          if (low + step >= parts)
+            return;
+          size_t begin = bounds[low], middle = bounds[low + step],
+                 end = bounds[std::min(low + 2 * step, parts)];
+          merge(results, scratch, begin, middle, end);
+          std::move(scratch.begin() + begin, scratch.begin() + end,
+                    results.begin() + begin);
+        });
+    }
+    // Splits the leftmost pending range until the row at position is in
+    // its final place
+    inline void refine() {
+      while (!pending.empty() && pending.back().first == position) {
+        auto [begin, end] = pending.back();
+        pending.pop_back();
+        if (end - begin <= 16) {
+          sort(results.begin() + begin, results.begin() + end,
+               [this](const unique_ptr<T> &first,
+                      const unique_ptr<T> &second) -> bool {
+                 return less(first, second);
+               });
+          continue;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        if (less(results[middle], results[begin]))
+          swap(results[middle], results[begin]);
+        if (less(results[end - 1], results[middle]))
+          swap(results[end - 1], results[middle]);
+        if (less(results[middle], results[begin]))
+          swap(results[middle], results[begin]);
+        // swaps move the owners around, not the rows they point to
+        const T *pivot = results[middle].get();
+        size_t lower = begin, current = begin, upper = end;
+        while (current < upper)
+          if (comparer(*results[current], *pivot))
+            swap(results[lower++], results[current++]);
+          else if (comparer(*pivot, *results[current]))
+            swap(results[current], results[--upper]);
+          else
+            ++current;
+        if (upper < end)
+          pending.emplace_back(upper, end);
+        if (begin < lower)
+          pending.emplace_back(begin, lower);
+      }
+    }
 
     void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
       this->previousFunction = previousFunction;
@@ -195,50 +1141,137 @@ namespace Pipeline {
       return previousFunction;
     }
     shared_ptr<Functor<T>> deepCopy() const {
-      auto copy = make_shared<OrderBy<T>>(comparer);
+      auto copy = make_shared<OrderBy<T>>(comparer, mode, threads);
+      copy->stateless = stateless;
+      copy->lineage = this->lineage;
       if (previousFunction)
         copy->previousFunction = previousFunction->deepCopy();
       return copy;
     }
-    inline unique_ptr<T> operator()(const bool &reset) {
-      if (reset) {
-        processed = false;
-        results.clear();
+    // whether the input is known to be ordered as this stage would order it
+    inline bool presorted() const {
+      return previousFunction &&
+             previousFunction->ordering().agrees(ordering());
+    }
+    void open() {
+      previousFunction->open();
+      passthrough = presorted();
+      processed = false;
+      results.clear();
+      pending.clear();
+      position = 0;
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (passthrough) {
+        auto result = previousFunction->next();
+        if (result != nullptr)
+          ++this->produced;
+        return result;
       }
       if (!processed) {
-        bool needReset = reset;
-        unique_ptr<T> result;
-        while (true) {
-          result = previousFunction->operator()(needReset);
-          if (result == nullptr)
-            break;
+        while (auto result = previousFunction->next())
           results.emplace_back(move(result));
-          needReset = false;
-        }
-        sort(results.begin(), results.end(),
-             [this](const unique_ptr<T> &first, const unique_ptr<T> &second)
-                 -> bool { return comparer(*first, *second); });
+        if (mode == SortMode::Incremental)
+          pending.emplace_back(0, results.size());
+        // equal integers cannot be told apart, so stability is kept
+        else if ((mode == SortMode::Full ||
+                  (mode == SortMode::Stable && std::is_integral_v<T>)) &&
+                 sortArithmetic())
+          ;
+        // one comparison per row spares sorting input that is already, or
+        // nearly, in order
+        else if (countRuns() == 1)
+          ;
+        else if (runs.size() - 1 <= results.size() / 32)
+          mergeRuns();
+        else if (mode == SortMode::Stable)
+          stableSort();
+        else
+          sort(results.begin(), results.end(),
+               [this](const unique_ptr<T> &first,
+                      const unique_ptr<T> &second) -> bool {
+                 return less(first, second);
+               });
+        processed = true;
       }
-      if (results.empty())
+      if (position == results.size())
         return nullptr;
-      unique_ptr<T> result = nullptr;
-      result.swap(results.front());
-      results.pop_front();
-      return result;
+      refine();
+      ++this->produced;
+      return move(results[position++]);
+    }
+    void close() {
+      previousFunction->close();
+      results.clear();
+      scratch.clear();
+      values.clear();
+      runs.clear();
+      pending.clear();
+      position = 0;
+    }
+    string describe() const {
+      if (presorted())
+        return "OrderBy(input already ordered)";
+      return signature();
+    }
+    string signature() const {
+      if (mode == SortMode::Incremental)
+        return "OrderBy(incremental)";
+      if (mode == SortMode::Stable)
+        return threads > 1 ? "OrderBy(stable, " + to_string(threads) +
+                                 " threads)"
+                           : "OrderBy(stable)";
+      return "OrderBy";
     }
+    string callable() const { return comparer.target_type().name(); }
+    // an incremental sort is charged for partitioning only, as the number of
+    // rows its consumer reads is not known in advance
+    double cost(const double &rows) const {
+      if (presorted())
+        return rows;
+      if (mode == SortMode::Incremental)
+        return 2 * rows;
+      return rows * std::log2(std::max(rows, 2.0));
+    }
+    Ordering<T> ordering() const { return {&comparer, stateless}; }
+    bool mapCount(size_t &) const { return true; }
 
   public:
-    OrderBy(const function<bool(const T &, const T &)> &comparer)
-        : previousFunction(nullptr), comparer(comparer), processed(false) {}
+    // threads is the parallelism of the stable sort; the comparer must then
+    // be safe to call concurrently
+    OrderBy(const function<bool(const T &, const T &)> &comparer,
+            const SortMode &mode = SortMode::Full, const size_t &threads = 1)
+        : previousFunction(nullptr), comparer(comparer), stateless(false),
+          mode(mode), threads(std::max<size_t>(threads, 1)), processed(false),
+          passthrough(false), position(0) {}
+    // An empty function object, such as a captureless lambda or std::less,
+    // always orders alike, so a later OrderBy by the same type can be
+    // skipped
+    template <typename F, typename = std::enable_if_t<std::is_empty_v<F>>>
+    OrderBy(const F &comparer, const SortMode &mode = SortMode::Full,
+            const size_t &threads = 1)
+        : OrderBy(function<bool(const T &, const T &)>(comparer), mode,
+                  threads) {
+      stateless = true;
+    }
     OrderBy(const OrderBy<T> &other)
         : previousFunction(other.previousFunction
                                ? other.previousFunction->deepCopy()
                                : nullptr),
-          comparer(other.comparer), processed(false) {}
+          comparer(other.comparer), stateless(other.stateless),
+          mode(other.mode), threads(other.threads), processed(false),
+          passthrough(false), position(0) {}
     OrderBy<T> &operator=(const OrderBy<T> &other) {
       comparer = other.comparer;
+      stateless = other.stateless;
+      mode = other.mode;
+      threads = other.threads;
       processed = false;
       results.clear();
+      scratch.clear();
+      pending.clear();
+      position = 0;
       previousFunction =
           other.previousFunction ? other.previousFunction->deepCopy() : nullptr;
       return *this;
@@ -247,52 +1280,1020 @@ namespace Pipeline {
     OrderBy<T> &operator=(OrderBy<T> &&other) = default;
   };
 
-  template <typename T> class Composer : public Functor<T> {
-    shared_ptr<Functor<T>> first, last;
+  // Orders rows by an integral key, computed once per row, keeping rows with
+  // equal keys in input order. Keys spanning a small range, either given as
+  // a hint or found while buffering, are sorted by counting in
+  // O(n + range); other keys fall back to a comparison sort.
+  template <typename T> class OrderByKey : public Functor<T> {
+    shared_ptr<Functor<T>> previousFunction;
+    function<long long(const T &)> key;
+    bool hinted;
+    long long lowest, highest;
+    bool processed, counted;
+    // kept between runs so that their capacity is reused
+    vector<unique_ptr<T>> rows, results;
+    vector<long long> keys;
+    vector<size_t> counts;
+    size_t position;
+
+    // counting pays off while the range is not much larger than the input
+    inline bool countable(const long long &low, const long long &high) const {
+      return static_cast<unsigned long long>(high) -
+                 static_cast<unsigned long long>(low) <=
+             2 * rows.size() + 1024;
+    }
+    inline void countingSort(const long long &low, const long long &high) {
+      counts.assign(static_cast<size_t>(high - low) + 2, 0);
+      for (auto &key : keys)
+        ++counts[key - low + 1];
+      for (size_t bucket = 1; bucket < counts.size(); ++bucket)
+        counts[bucket] += counts[bucket - 1];
+      results.resize(rows.size());
+      for (size_t index = 0; index < rows.size(); ++index)
+        results[counts[keys[index] - low]++] = move(rows[index]);
+    }
+    inline void comparisonSort() {
+      counts.resize(rows.size());
+      for (size_t index = 0; index < counts.size(); ++index)
+        counts[index] = index;
+      std::stable_sort(counts.begin(), counts.end(),
+                       [this](const size_t &first, const size_t &second) {
+                         return keys[first] < keys[second];
+                       });
+      results.resize(rows.size());
+      for (size_t index = 0; index < counts.size(); ++index)
+        results[index] = move(rows[counts[index]]);
+    }
 
-    class Iterate : public Functor<T> {
-      typename vector<T>::const_iterator it, end;
+    void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
+      this->previousFunction = previousFunction;
+    }
+    shared_ptr<Functor<T>> getPreviousFunction() const {
+      return previousFunction;
+    }
+    shared_ptr<Functor<T>> deepCopy() const {
+      auto copy = hinted ? make_shared<OrderByKey<T>>(key, lowest, highest)
+                         : make_shared<OrderByKey<T>>(key);
+      copy->lineage = this->lineage;
+      if (previousFunction)
+        copy->previousFunction = previousFunction->deepCopy();
+      return copy;
+    }
+    void open() {
+      previousFunction->open();
+      processed = false;
+      rows.clear();
+      results.clear();
+      keys.clear();
+      position = 0;
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (!processed) {
+        long long low = hinted ? lowest : std::numeric_limits<long long>::max();
+        long long high = hinted ? highest : std::numeric_limits<long long>::min();
+        bool inRange = true;
+        while (auto result = previousFunction->next()) {
+          keys.push_back(key(*result));
+          rows.emplace_back(move(result));
+          if (hinted)
+            inRange = inRange && low <= keys.back() && keys.back() <= high;
+          else {
+            low = std::min(low, keys.back());
+            high = std::max(high, keys.back());
+          }
+        }
+        counted = !rows.empty() && inRange && countable(low, high);
+        if (counted)
+          countingSort(low, high);
+        else
+          comparisonSort();
+        rows.clear();
+        processed = true;
+      }
+      if (position == results.size())
+        return nullptr;
+      ++this->produced;
+      return move(results[position++]);
+    }
+    void close() {
+      previousFunction->close();
+      rows.clear();
+      results.clear();
+      keys.clear();
+      position = 0;
+    }
+    string describe() const {
+      return processed && counted ? signature() + "(counting)" : signature();
+    }
+    string signature() const {
+      string name = "OrderByKey";
+      if (hinted)
+        name += "[" + to_string(lowest) + ".." + to_string(highest) + "]";
+      return name;
+    }
+    string callable() const { return key.target_type().name(); }
+    double cost(const double &rows) const {
+      // the range is taken unsigned, as in countable, so that the widest
+      // hints do not overflow
+      if (hinted && lowest <= highest)
+        return rows + static_cast<double>(
+                          static_cast<unsigned long long>(highest) -
+                          static_cast<unsigned long long>(lowest));
+      return rows * std::log2(std::max(rows, 2.0));
+    }
+    bool mapCount(size_t &) const { return true; }
 
-    public:
-      template <typename C>
-      Iterate(const C &values) : it(cbegin(values)), end(cend(values)) {}
-      Iterate(const Iterate &other) = default;
-      Iterate(Iterate &&other) = default;
-      Iterate &operator=(const Iterate &other) = default;
-      Iterate &operator=(Iterate &&other) = default;
-      void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {}
-      shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
-      shared_ptr<Functor<T>> deepCopy() const {
-        return make_shared<Iterate>(*this);
+  public:
+    OrderByKey(const function<long long(const T &)> &key)
+        : previousFunction(nullptr), key(key), hinted(false), lowest(0),
+          highest(0), processed(false), counted(false), position(0) {}
+    // Keys are expected within [lowest, highest]; a key outside of it makes
+    // the stage fall back to a comparison sort
+    OrderByKey(const function<long long(const T &)> &key,
+               const long long &lowest, const long long &highest)
+        : previousFunction(nullptr), key(key), hinted(true), lowest(lowest),
+          highest(highest), processed(false), counted(false), position(0) {}
+    OrderByKey(const OrderByKey<T> &other)
+        : previousFunction(other.previousFunction
+                               ? other.previousFunction->deepCopy()
+                               : nullptr),
+          key(other.key), hinted(other.hinted), lowest(other.lowest),
+          highest(other.highest), processed(false), counted(false),
+          position(0) {}
+    OrderByKey<T> &operator=(const OrderByKey<T> &other) {
+      key = other.key;
+      hinted = other.hinted;
+      lowest = other.lowest;
+      highest = other.highest;
+      processed = counted = false;
+      rows.clear();
+      results.clear();
+      keys.clear();
+      position = 0;
+      previousFunction =
+          other.previousFunction ? other.previousFunction->deepCopy() : nullptr;
+      return *this;
+    }
+    OrderByKey(OrderByKey<T> &&other) = default;
+    OrderByKey<T> &operator=(OrderByKey<T> &&other) = default;
+  };
+
+  // Orders rows by a key that an encoder writes into a SortKey, keeping
+  // rows with equal keys in input order. Keys are encoded once per row into
+  // one buffer, radix sorted on their first eight bytes, and rows whose
+  // first eight bytes tie are ordered by memcmp of the rest of their keys.
+  template <typename T> class OrderByNormalized : public Functor<T> {
+    struct Entry {
+      uint64_t prefix;
+      size_t row;
+    };
+
+    shared_ptr<Functor<T>> previousFunction;
+    function<void(const T &, SortKey &)> encoder;
+    bool processed;
+    // kept between runs so that their capacity is reused
+    SortKey key;
+    string keys;
+    vector<size_t> offsets;
+    vector<Entry> entries, scratch;
+    vector<unique_ptr<T>> rows;
+    size_t position;
+
+    // orders the bytes of two keys that follow their common prefix
+    inline bool tailLess(const Entry &first, const Entry &second) const {
+      size_t firstBegin = std::min(offsets[first.row] + 8,
+                                   offsets[first.row + 1]),
+             secondBegin = std::min(offsets[second.row] + 8,
+                                    offsets[second.row + 1]);
+      size_t firstSize = offsets[first.row + 1] - firstBegin,
+             secondSize = offsets[second.row + 1] - secondBegin;
+      int order = std::memcmp(keys.data() + firstBegin,
+                              keys.data() + secondBegin,
+                              std::min(firstSize, secondSize));
+      return order ? order < 0 : firstSize < secondSize;
+    }
+    inline void radixSort() {
+      scratch.resize(entries.size());
+      size_t counts[256];
+      for (size_t shift = 0; shift < 64; shift += 8) {
+        std::fill(counts, counts + 256, 0);
+        for (auto &entry : entries)
+          ++counts[(entry.prefix >> shift) & 0xFF];
+        // a byte that is the same in every key leaves the order as it is
+        if (counts[(entries.front().prefix >> shift) & 0xFF] == entries.size())
+          continue;
+        for (size_t bucket = 0, total = 0; bucket < 256; ++bucket)
+          total += std::exchange(counts[bucket], total);
+        for (auto &entry : entries)
+          scratch[counts[(entry.prefix >> shift) & 0xFF]++] = entry;
+        entries.swap(scratch);
+      }
+    }
+    inline void sortEntries() {
+      auto prefixLess = [](const Entry &first, const Entry &second) {
+        return first.prefix < second.prefix;
+      };
+      if (entries.size() < 256)
+        std::stable_sort(entries.begin(), entries.end(), prefixLess);
+      else
+        radixSort();
+      for (size_t begin = 0, end; begin < entries.size(); begin = end) {
+        for (end = begin + 1; end < entries.size() &&
+                              entries[end].prefix == entries[begin].prefix;
+             ++end)
+          ;
+        if (end - begin > 1)
+          std::stable_sort(
+              entries.begin() + begin, entries.begin() + end,
+              [this](const Entry &first, const Entry &second) {
+                return tailLess(first, second);
+              });
+      }
+    }
+
+    void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
+      this->previousFunction = previousFunction;
+    }
+    shared_ptr<Functor<T>> getPreviousFunction() const {
+      return previousFunction;
+    }
+    shared_ptr<Functor<T>> deepCopy() const {
+      auto copy = make_shared<OrderByNormalized<T>>(encoder);
+      copy->lineage = this->lineage;
+      if (previousFunction)
+        copy->previousFunction = previousFunction->deepCopy();
+      return copy;
+    }
+    void open() {
+      previousFunction->open();
+      processed = false;
+      keys.clear();
+      offsets.assign(1, 0);
+      entries.clear();
+      rows.clear();
+      position = 0;
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (!processed) {
+        while (auto result = previousFunction->next()) {
+          key.clear();
+          encoder(*result, key);
+          uint64_t prefix = 0;
+          for (size_t index = 0; index < 8; ++index)
+            prefix = prefix << 8 |
+                     (index < key.str().size()
+                          ? static_cast<unsigned char>(key.str()[index])
+                          : 0);
+          entries.push_back({prefix, rows.size()});
+          keys += key.str();
+          offsets.push_back(keys.size());
+          rows.emplace_back(move(result));
+        }
+        sortEntries();
+        processed = true;
       }
-      inline unique_ptr<T> operator()(const bool &reset) {
-        if (it == end)
+      if (position == entries.size())
+        return nullptr;
+      ++this->produced;
+      return move(rows[entries[position++].row]);
+    }
+    void close() {
+      previousFunction->close();
+      keys.clear();
+      offsets.clear();
+      entries.clear();
+      scratch.clear();
+      rows.clear();
+      position = 0;
+    }
+    string describe() const { return "OrderByNormalized"; }
+    string callable() const { return encoder.target_type().name(); }
+    double cost(const double &rows) const {
+      return rows * std::log2(std::max(rows, 2.0));
+    }
+    bool mapCount(size_t &) const { return true; }
+
+  public:
+    OrderByNormalized(const function<void(const T &, SortKey &)> &encoder)
+        : previousFunction(nullptr), encoder(encoder), processed(false),
+          offsets(1, 0), position(0) {}
+    OrderByNormalized(const OrderByNormalized<T> &other)
+        : previousFunction(other.previousFunction
+                               ? other.previousFunction->deepCopy()
+                               : nullptr),
+          encoder(other.encoder), processed(false), offsets(1, 0),
+          position(0) {}
+    OrderByNormalized<T> &operator=(const OrderByNormalized<T> &other) {
+      encoder = other.encoder;
+      processed = false;
+      keys.clear();
+      offsets.assign(1, 0);
+      entries.clear();
+      rows.clear();
+      position = 0;
+      previousFunction =
+          other.previousFunction ? other.previousFunction->deepCopy() : nullptr;
+      return *this;
+    }
+    OrderByNormalized(OrderByNormalized<T> &&other) = default;
+    OrderByNormalized<T> &operator=(OrderByNormalized<T> &&other) = default;
+  };
+
+  // Reads the values of a container that outlives it. Its bounds are taken
+  // on open, so a container that changed between runs is read as it is now.
+  template <typename T, typename C> class Iterate : public Functor<T> {
+    const C *values;
+    typename C::const_iterator it, end;
+
+  public:
+    Iterate(const C &values)
+        : values(&values), it(cbegin(values)), end(cend(values)) {}
+    Iterate(const Iterate &other) = default;
+    Iterate(Iterate &&other) = default;
+    Iterate &operator=(const Iterate &other) = default;
+    Iterate &operator=(Iterate &&other) = default;
+    void setPreviousFunction(shared_ptr<Functor<T>>) {}
+    shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+    shared_ptr<Functor<T>> deepCopy() const {
+      return make_shared<Iterate>(*this);
+    }
+    // Points the source at another container, read from the next open on
+    void rebind(const C &values) { this->values = &values; }
+    void open() {
+      it = cbegin(*values);
+      end = cend(*values);
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (it == end)
+        return nullptr;
+      auto result = make_unique<T>(*it);
+      ++it;
+      ++this->produced;
+      return result;
+    }
+    void close() {}
+    string describe() const { return "Source"; }
+  };
+
+  // Wraps values as the source of a run: a source stage is copied and a
+  // container is read through Iterate
+  template <typename T, typename C>
+  inline shared_ptr<Functor<T>> makeSource(const C &values) {
+    if constexpr (std::is_base_of_v<Functor<T>, C>)
+      return static_cast<const Functor<T> &>(values).deepCopy();
+    else
+      return make_shared<Iterate<T, C>>(values);
+  }
+
+  // Lazily merges inputs that are each sorted by comparer, through a loser
+  // tree that costs about log2(inputs) comparisons per row. Rows that
+  // compare equal keep the order of their inputs. The inputs may be
+  // containers, which must outlive the source, or source stages.
+  template <typename T> class MergeSorted : public Functor<T> {
+    vector<shared_ptr<Functor<T>>> sources;
+    function<bool(const T &, const T &)> comparer;
+    bool stateless;
+    // the current row of every input, null once the input is exhausted
+    vector<unique_ptr<T>> heads;
+    // tree[0] is the input holding the smallest row; tree[node] is the
+    // input that lost the match at node, whose children are 2 * node and
+    // 2 * node + 1, with input i as leaf i + inputs
+    vector<size_t> tree;
+
+    inline bool beats(const size_t &first, const size_t &second) const {
+      if (heads[second] == nullptr)
+        return true;
+      if (heads[first] == nullptr)
+        return false;
+      return first < second ? !comparer(*heads[second], *heads[first])
+                            : comparer(*heads[first], *heads[second]);
+    }
+    // plays the matches below node and returns their winner
+    size_t play(const size_t &node) {
+      if (node >= sources.size())
+        return node - sources.size();
+      size_t left = play(2 * node), right = play(2 * node + 1);
+      if (beats(left, right)) {
+        tree[node] = right;
+        return left;
+      }
+      tree[node] = left;
+      return right;
+    }
+
+  public:
+    template <typename R, typename F>
+    MergeSorted(const R &inputs, const F &comparer)
+        : comparer(comparer), stateless(std::is_empty_v<F>) {
+      using C = std::decay_t<decltype(*cbegin(inputs))>;
+      for (auto it = cbegin(inputs); it != cend(inputs); ++it)
+        sources.push_back(makeSource<T, C>(*it));
+    }
+    MergeSorted(const MergeSorted<T> &other)
+        : comparer(other.comparer), stateless(other.stateless) {
+      for (auto &source : other.sources)
+        sources.push_back(source->deepCopy());
+    }
+    MergeSorted<T> &operator=(const MergeSorted<T> &other) {
+      comparer = other.comparer;
+      stateless = other.stateless;
+      sources.clear();
+      for (auto &source : other.sources)
+        sources.push_back(source->deepCopy());
+      heads.clear();
+      tree.clear();
+      return *this;
+    }
+    MergeSorted(MergeSorted<T> &&other) = default;
+    MergeSorted<T> &operator=(MergeSorted<T> &&other) = default;
+    void setPreviousFunction(shared_ptr<Functor<T>>) {}
+    shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+    shared_ptr<Functor<T>> deepCopy() const {
+      return make_shared<MergeSorted<T>>(*this);
+    }
+    void open() {
+      heads.resize(sources.size());
+      for (size_t index = 0; index < sources.size(); ++index) {
+        sources[index]->open();
+        heads[index] = sources[index]->next();
+      }
+      tree.assign(std::max<size_t>(sources.size(), 1), 0);
+      if (!sources.empty())
+        tree[0] = play(1);
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (sources.empty() || heads[tree[0]] == nullptr)
+        return nullptr;
+      size_t winner = tree[0];
+      auto result = move(heads[winner]);
+      heads[winner] = sources[winner]->next();
+      // only the matches on the path from the winner's leaf are replayed
+      for (size_t node = (winner + sources.size()) / 2; node > 0; node /= 2)
+        if (beats(tree[node], winner))
+          std::swap(tree[node], winner);
+      tree[0] = winner;
+      ++this->produced;
+      return result;
+    }
+    void close() {
+      for (auto &source : sources)
+        source->close();
+      heads.clear();
+    }
+    string describe() const {
+      return "MergeSorted(" + to_string(sources.size()) + " inputs)";
+    }
+    double cost(const double &rows) const {
+      return rows * std::max(std::log2(sources.size()), 1.0);
+    }
+    Ordering<T> ordering() const { return {&comparer, stateless}; }
+  };
+
+  // Calls generator for rows until it returns null. The generator keeps its
+  // own state, so a run goes on from where the previous one stopped.
+  template <typename T> class Generate : public Functor<T> {
+    function<unique_ptr<T>()> generator;
+
+  public:
+    Generate(const function<unique_ptr<T>()> &generator)
+        : generator(generator) {}
+    void setPreviousFunction(shared_ptr<Functor<T>>) {}
+    shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+    shared_ptr<Functor<T>> deepCopy() const {
+      return make_shared<Generate<T>>(*this);
+    }
+    void open() { this->produced = 0; }
+    inline unique_ptr<T> next() {
+      auto result = generator();
+      if (result != nullptr)
+        ++this->produced;
+      return result;
+    }
+    void close() {}
+    string describe() const { return "Generate"; }
+  };
+
+  // Reads another source on a background thread, a block of up to size
+  // rows at a time, into a ring of blocks, so that slow reads overlap with
+  // the work of the stages downstream. The thread is started on open and
+  // joined on close; an exception it throws is rethrown from next once the
+  // rows read before it have been handed over.
+  template <typename T> class Prefetch : public Functor<T> {
+    shared_ptr<Functor<T>> source;
+    size_t size;
+    vector<vector<T>> ring;
+    // blocks filled and not yet released by the reader, the block being
+    // read and the next row in it
+    size_t filled, head, position;
+    bool reading, finished, stopping;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable ready, free;
+    std::thread worker;
+
+    void fill() {
+      try {
+        for (size_t tail = 0;; tail = (tail + 1) % ring.size()) {
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            free.wait(lock,
+                      [this] { return stopping || filled < ring.size(); });
+            if (stopping)
+              return;
+          }
+          // the reader does not touch blocks that are not filled
+          auto &block = ring[tail];
+          block.clear();
+          while (block.size() < size)
+            if (auto result = source->next())
+              block.emplace_back(move(*result));
+            else
+              break;
+          bool last = block.size() < size;
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++filled;
+            finished = last;
+          }
+          ready.notify_one();
+          if (last)
+            return;
+        }
+      } catch (...) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          error = std::current_exception();
+          finished = true;
+        }
+        ready.notify_one();
+      }
+    }
+    void stop() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      free.notify_one();
+      if (worker.joinable())
+        worker.join();
+    }
+
+  public:
+    template <typename C, typename = std::enable_if_t<
+                              !std::is_same_v<std::decay_t<C>, Prefetch<T>>>>
+    Prefetch(const C &values, const size_t &size = 1024,
+             const size_t &blocks = 3)
+        : source(makeSource<T>(values)), size(std::max<size_t>(size, 1)),
+          ring(std::max<size_t>(blocks, 2)), filled(0), head(0), position(0),
+          reading(false), finished(false), stopping(false) {}
+    Prefetch(const Prefetch<T> &other)
+        : source(other.source->deepCopy()), size(other.size),
+          ring(other.ring.size()), filled(0), head(0), position(0),
+          reading(false), finished(false), stopping(false) {}
+    Prefetch<T> &operator=(const Prefetch<T> &other) {
+      stop();
+      source = other.source->deepCopy();
+      size = other.size;
+      ring.assign(other.ring.size(), vector<T>());
+      return *this;
+    }
+    ~Prefetch() { stop(); }
+    void setPreviousFunction(shared_ptr<Functor<T>>) {}
+    shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+    shared_ptr<Functor<T>> deepCopy() const {
+      return make_shared<Prefetch<T>>(*this);
+    }
+    void open() {
+      stop();
+      source->open();
+      filled = head = position = 0;
+      reading = finished = stopping = false;
+      error = nullptr;
+      this->produced = 0;
+      worker = std::thread(&Prefetch<T>::fill, this);
+    }
+    inline unique_ptr<T> next() {
+      while (true) {
+        if (reading) {
+          if (position < ring[head].size()) {
+            ++this->produced;
+            return make_unique<T>(move(ring[head][position++]));
+          }
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            --filled;
+          }
+          free.notify_one();
+          reading = false;
+          head = (head + 1) % ring.size();
+          position = 0;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return filled > 0 || finished; });
+        if (filled == 0) {
+          if (error)
+            std::rethrow_exception(error);
           return nullptr;
-        auto result = make_unique<T>(*it);
-        ++it;
-        return result;
+        }
+        reading = true;
+      }
+    }
+    void close() {
+      stop();
+      source->close();
+    }
+    string describe() const {
+      return "Prefetch(" + source->describe() + ")";
+    }
+  };
+
+  // Yields the rows of a container that outlives it at the given positions,
+  // in their order
+  template <typename T, typename C = vector<T>>
+  class Gather : public Functor<T> {
+    const C *values;
+    // shared by copies, as it does not change
+    shared_ptr<const vector<size_t>> positions;
+    size_t cursor;
+
+  public:
+    Gather(const C &values, vector<size_t> positions)
+        : values(&values),
+          positions(make_shared<const vector<size_t>>(move(positions))),
+          cursor(0) {}
+    void setPreviousFunction(shared_ptr<Functor<T>>) {}
+    shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+    shared_ptr<Functor<T>> deepCopy() const {
+      return make_shared<Gather>(*this);
+    }
+    void open() {
+      cursor = 0;
+      this->produced = 0;
+    }
+    inline unique_ptr<T> next() {
+      if (cursor == positions->size())
+        return nullptr;
+      ++this->produced;
+      return make_unique<T>(cbegin(*values)[(*positions)[cursor++]]);
+    }
+    void close() {}
+    string describe() const {
+      return "Gather(" + to_string(positions->size()) + " rows)";
+    }
+    inline size_t size() const { return positions->size(); }
+  };
+
+  // An index on a key of the rows of a container that outlives it. Built
+  // once, it answers equality and, when sorted, range lookups with a binary
+  // search or a hash lookup in place of a scan, as a source that yields the
+  // matching rows in container order. It must be rebuilt after the
+  // container changes. The kind is fixed by the type, so that a key a hash
+  // index cannot hash, or a range asked of one, fails to compile.
+  template <typename T, typename K, IndexKind Kind = IndexKind::Sorted,
+            typename C = vector<T>>
+  class Index {
+    static_assert(
+        std::is_base_of_v<std::random_access_iterator_tag,
+                          typename std::iterator_traits<
+                              typename C::const_iterator>::iterator_category>,
+        "an index refers to rows by position");
+    static_assert(Kind != IndexKind::Hash || HashableValue<K>,
+                  "the keys of a hash index must be hashable");
+
+    const C *values;
+    function<K(const T &)> key;
+    // a sorted index: the keys in order, and the position of the row of
+    // each, rows with equal keys in container order
+    vector<K> keys;
+    vector<size_t> positions;
+    // a hash index: the positions of the rows by the hash of their key
+    unordered_map<uint64_t, vector<size_t>> buckets;
+
+    inline const T &row(const size_t &position) const {
+      return cbegin(*values)[position];
+    }
+
+  public:
+    Index(const C &values, const function<K(const T &)> &key)
+        : values(&values), key(key) {
+      Rebuild();
+    }
+    void Rebuild() {
+      size_t rows = std::distance(cbegin(*values), cend(*values));
+      keys.clear();
+      positions.clear();
+      buckets.clear();
+      if constexpr (Kind == IndexKind::Hash) {
+        for (size_t position = 0; position < rows; ++position)
+          buckets[hashValue(key(row(position)))].push_back(position);
+      } else {
+        vector<K> unordered;
+        unordered.reserve(rows);
+        for (size_t position = 0; position < rows; ++position)
+          unordered.push_back(key(row(position)));
+        positions.resize(rows);
+        std::iota(positions.begin(), positions.end(), 0);
+        std::stable_sort(
+            positions.begin(), positions.end(),
+            [&unordered](const size_t &first, const size_t &second) {
+              return unordered[first] < unordered[second];
+            });
+        keys.reserve(rows);
+        for (auto &position : positions)
+          keys.push_back(move(unordered[position]));
+      }
+    }
+    // The rows whose key equals value
+    Gather<T, C> Equal(const K &value) const {
+      vector<size_t> found;
+      if constexpr (Kind == IndexKind::Hash) {
+        auto bucket = buckets.find(hashValue(value));
+        if (bucket != buckets.end())
+          for (auto &position : bucket->second)
+            if (key(row(position)) == value)
+              found.push_back(position);
+      } else {
+        auto range = std::equal_range(keys.begin(), keys.end(), value);
+        found.assign(positions.begin() + (range.first - keys.begin()),
+                     positions.begin() + (range.second - keys.begin()));
       }
+      return Gather<T, C>(*values, move(found));
+    }
+    // The rows whose key lies in [lowest, highest]; only a sorted index
+    // answers ranges
+    Gather<T, C> Range(const K &lowest, const K &highest) const {
+      static_assert(Kind == IndexKind::Sorted,
+                    "a hash index answers only Equal");
+      auto begin = std::lower_bound(keys.begin(), keys.end(), lowest);
+      auto end = std::max(begin, std::upper_bound(begin, keys.end(), highest));
+      vector<size_t> found(positions.begin() + (begin - keys.begin()),
+                           positions.begin() + (end - keys.begin()));
+      std::sort(found.begin(), found.end());
+      return Gather<T, C>(*values, move(found));
+    }
+  };
+
+  template <typename T> class Composer : public Functor<T> {
+    friend MultiQuery<T>;
+
+    shared_ptr<Functor<T>> first, last;
+    // a named parameter: the cell shared with copies of this pipeline, its
+    // type, a hash of its current value for the result cache, and a setter
+    // that converts a value of another type to it
+    struct Named {
+      shared_ptr<void> value;
+      type_index type;
+      function<uint64_t()> hash;
+      function<bool(const std::any &)> assign;
     };
+    unordered_map<string, Named> parameters;
+    // the results of recent runs, keyed by their input and parameters, the
+    // most recently used last; cacheEntries is zero while caching is off
+    size_t cacheEntries = 0, cacheSample = 0;
+    vector<std::pair<uint64_t, vector<T>>> cache;
+    // hashes an input row in place of hashValue when given
+    function<uint64_t(const T &)> cacheHasher;
+    bool executed = false;
+    size_t inputRows = 0, inputRead = 0;
+    string execution = "pull", origin = "Source";
 
     template <typename C> inline vector<T> preprocess(const C &values) {
+      vector<T> results;
+      process(values, [&results](T &result) {
+        results.emplace_back(move(result));
+        return true;
+      });
+      return results;
+    }
+    // output, when given, is the stage of this pipeline whose rows are
+    // handed to sink in place of the pipeline's own. The pipeline is rewired
+    // to its own input even when a stage throws, so that it holds on to
+    // neither values nor the source reading them.
+    template <typename C, typename F>
+    inline void process(const C &values, F &&sink,
+                        Functor<T> *output = nullptr) {
       auto base = last->getPreviousFunction();
-      last->setPreviousFunction(make_shared<Iterate>(values));
-      auto result = processAll();
+      auto source = makeSource<T>(values);
+      last->setPreviousFunction(source);
+      try {
+        drain(sink, output);
+      } catch (...) {
+        last->setPreviousFunction(base);
+        throw;
+      }
       last->setPreviousFunction(base);
-      return result;
+      record(values, *source);
+      execution = "pull";
     }
-    inline vector<T> processAll() {
-      vector<T> results;
-      bool reset = true;
-      while (true) {
-        auto result = first->operator()(reset);
-        if (result == nullptr)
-          break;
-        results.emplace_back(move(*result));
-        reset = false;
+    // Runs the pipeline over inputs[index] for every index in [begin, end),
+    // wiring a single source that is rebound to each input in turn
+    template <typename C>
+    inline void processMany(const vector<const C *> &inputs,
+                            vector<vector<T>> &results, const size_t &begin,
+                            const size_t &end) {
+      auto base = last->getPreviousFunction();
+      auto source = make_shared<Iterate<T, C>>(*inputs[begin]);
+      last->setPreviousFunction(source);
+      try {
+        for (size_t index = begin; index < end; ++index) {
+          source->rebind(*inputs[index]);
+          processAll(results[index]);
+        }
+      } catch (...) {
+        last->setPreviousFunction(base);
+        throw;
       }
+      last->setPreviousFunction(base);
+      record(*inputs[end - 1], *source);
+    }
+    inline void processAll(vector<T> &results) {
+      drain([&results](T &result) {
+        results.emplace_back(move(result));
+        return true;
+      });
+    }
+    // Hands every output row to sink until it returns false. The stages are
+    // closed even when one of them or sink throws, which stops the threads
+    // of sources such as Prefetch and releases the rows a stage buffered.
+    template <typename F>
+    inline void drain(F &&sink, Functor<T> *output = nullptr) {
+      if (output == nullptr)
+        output = first.get();
+      output->open();
+      try {
+        while (auto result = output->next())
+          if (!sink(*result))
+            break;
+      } catch (...) {
+        output->close();
+        throw;
+      }
+      output->close();
+    }
+    // Adapts a ForEach callback, which may return void to mean "continue"
+    template <typename F, typename... Args>
+    static inline bool proceed(F &callback, Args &&...args) {
+      if constexpr (std::is_same_v<std::invoke_result_t<F &, Args...>, bool>)
+        return callback(std::forward<Args>(args)...);
+      else {
+        callback(std::forward<Args>(args)...);
+        return true;
+      }
+    }
+    // Groups the rows into batches of up to size rows, reusing one buffer
+    template <typename F> static inline auto batches(F &callback, size_t size) {
+      size = std::max<size_t>(size, 1);
+      return [&callback, size, buffer = vector<T>()](T *row) mutable {
+        if (row != nullptr) {
+          if (buffer.capacity() < size)
+            buffer.reserve(size);
+          buffer.emplace_back(move(*row));
+          if (buffer.size() < size)
+            return true;
+        } else if (buffer.empty())
+          return true;
+        bool more = proceed(callback, Span<T>(buffer.data(), buffer.size()));
+        buffer.clear();
+        return more;
+      };
+    }
+    // Whether rows can be read from values by position, from either end
+    template <typename C> static constexpr bool bidirectional() {
+      if constexpr (std::is_base_of_v<Functor<T>, C>)
+        return false;
+      else
+        return std::is_base_of_v<
+            std::bidirectional_iterator_tag,
+            typename std::iterator_traits<
+                typename C::const_iterator>::iterator_category>;
+    }
+    // Whether every stage yields input row i as output row i, so that the
+    // output is the first length input rows, mapped
+    inline bool direct(size_t &length,
+                       vector<const Functor<T> *> &stages) const {
+      flatten(stages);
+      for (auto stage = stages.rbegin(); stage != stages.rend(); ++stage)
+        if (!(*stage)->mapIndex(length))
+          return false;
+      return true;
+    }
+    static inline T map(T value, const vector<const Functor<T> *> &stages) {
+      for (auto stage = stages.rbegin(); stage != stages.rend(); ++stage)
+        (*stage)->mapValue(value);
+      return value;
+    }
+    // Counts the output rows, up to limit, running only the stages up to
+    // the last one whose count depends on the rows themselves, such as a
+    // Where; the counts of the stages after it follow from its count. As
+    // those never raise a count, the most rows they let through, e.g. the
+    // count of a Take, caps the rows counted.
+    template <typename C>
+    inline size_t cardinality(const C &values, size_t limit) {
+      vector<const Functor<T> *> stages;
+      flatten(stages);
+      size_t live = 0;
+      for (size_t probe = 0;
+           live < stages.size() && stages[live]->mapCount(probe);)
+        ++live;
+      size_t cap = std::numeric_limits<size_t>::max();
+      for (size_t stage = live; stage > 0;)
+        stages[--stage]->mapCount(cap);
+      limit = std::min(limit, cap);
+      size_t count = 0;
+      if (limit == 0)
+        return 0;
+      auto counter = [&count, &limit](T &) { return ++count < limit; };
+      if (live < stages.size())
+        // the stages are this pipeline's own, and it is not const
+        process(values, counter, const_cast<Functor<T> *>(stages[live]));
+      else if constexpr (std::is_base_of_v<Functor<T>, C>) {
+        auto source = makeSource<T>(values);
+        drain(counter, source.get());
+        record(values, *source);
+      } else
+        count = std::min<size_t>(std::distance(cbegin(values), cend(values)),
+                                 limit);
+      while (live > 0)
+        stages[--live]->mapCount(count);
+      return count;
+    }
+    // Hashes the names and values of the parameters, without regard to
+    // order, as copies of the pipeline may iterate them differently
+    inline uint64_t hashParameters() const {
+      uint64_t hash = 0;
+      for (auto &parameter : parameters)
+        hash += hashCombine(
+            hashBytes(parameter.first.data(), parameter.first.size()),
+            parameter.second.hash());
+      return hash;
+    }
+    // Hashes the input, as one block of bytes when its rows have no padding
+    // and the caller gave no hasher of their own
+    template <typename C> inline uint64_t hashInput(const C &values) const {
+      using E = std::decay_t<decltype(*cbegin(values))>;
+      using Category = typename std::iterator_traits<decltype(
+          cbegin(values))>::iterator_category;
+      size_t rows = std::distance(cbegin(values), cend(values));
+      bool sampled = cacheSample && rows > cacheSample;
+      if constexpr (std::is_same_v<C, vector<E>> ||
+                    std::is_same_v<C, initializer_list<E>>)
+        if constexpr (std::has_unique_object_representations_v<E>)
+          if (!sampled && !cacheHasher)
+            return hashBytes(std::data(values), rows * sizeof(E));
+      auto hashRow = [this](const E &row) -> uint64_t {
+        if constexpr (std::is_same_v<E, T>)
+          if (cacheHasher)
+            return cacheHasher(row);
+        return hashValue(row);
+      };
+      uint64_t hash = rows;
+      if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                      Category>) {
+        if (sampled) {
+          for (size_t index = 0; index < cacheSample; ++index)
+            hash = hashCombine(
+                hash, hashRow(cbegin(values)[index * rows / cacheSample]));
+          return hash;
+        }
+      }
+      size_t stride = sampled ? rows / cacheSample : 1, index = 0;
+      for (auto it = cbegin(values); it != cend(values); ++it, ++index)
+        if (index % stride == 0)
+          hash = hashCombine(hash, hashRow(*it));
+      return hash;
+    }
+    // Runs the pipeline through the cache, under the key of the input and
+    // the fingerprint, whose stage signatures carry values such as a Take's
+    // limit even when its cell is not registered
+    template <typename C>
+    inline vector<T> cached(const C &values, uint64_t key) {
+      key = hashCombine(key, Fingerprint());
+      for (auto entry = cache.begin(); entry != cache.end(); ++entry)
+        if (entry->first == key) {
+          std::rotate(entry, entry + 1, cache.end());
+          execution = "cached";
+          return cache.back().second;
+        }
+      auto results = preprocess(values);
+      if (cache.size() >= cacheEntries)
+        cache.erase(cache.begin(), cache.end() - (cacheEntries - 1));
+      cache.emplace_back(key, results);
       return results;
     }
+    template <typename C>
+    inline void record(const C &values, const Functor<T> &source) {
+      executed = true;
+      if constexpr (std::is_base_of_v<Functor<T>, C>)
+        inputRows = source.produced;
+      else
+        inputRows = std::distance(cbegin(values), cend(values));
+      inputRead = source.produced;
+      origin = source.describe();
+    }
     void setPreviousFunction(shared_ptr<Functor<T>> previousFunction) {
       last->setPreviousFunction(previousFunction);
     }
@@ -308,27 +2309,119 @@ namespace Pipeline {
       }
       return copy;
     }
-    inline unique_ptr<T> operator()(const bool &reset) {
-      return first->operator()(reset);
+    void open() { first->open(); }
+    inline unique_ptr<T> next() { return first->next(); }
+    void close() { first->close(); }
+    Ordering<T> ordering() const {
+      return first ? first->ordering() : Ordering<T>();
+    }
+    string describe() const { return "Composer"; }
+    void flatten(vector<const Functor<T> *> &stages) const {
+      for (const Functor<T> *node = first.get(); node != nullptr;
+           node = node == last.get() ? nullptr
+                                     : node->getPreviousFunction().get())
+        node->flatten(stages);
     }
 
   public:
+    // A copy of a pipeline wired to a source once, so that running it again,
+    // e.g. after the source changed, needs no setup allocations.
+    template <typename C> class Bound {
+      Composer<T> pipeline;
+      const C *values;
+      shared_ptr<Functor<T>> source;
+
+    public:
+      Bound(const Composer<T> &pipeline, const C &values)
+          : pipeline(pipeline), values(&values),
+            source(makeSource<T>(values)) {
+        this->pipeline.last->setPreviousFunction(source);
+      }
+      Bound(const Bound &other) = delete;
+      Bound &operator=(const Bound &other) = delete;
+      Bound(Bound &&other) = default;
+      Bound &operator=(Bound &&other) = default;
+      // Replaces the contents of results, reusing its capacity
+      inline void ToList(vector<T> &results) {
+        results.clear();
+        pipeline.processAll(results);
+        pipeline.record(*values, *source);
+      }
+      inline vector<T> ToList() {
+        vector<T> results;
+        ToList(results);
+        return results;
+      }
+      template <typename F> inline void ForEach(F callback) {
+        pipeline.drain(
+            [&callback](T &result) { return proceed(callback, result); });
+        pipeline.record(*values, *source);
+      }
+      template <typename F>
+      inline void ForEachBatch(F callback, const size_t &size) {
+        auto batch = batches(callback, size);
+        pipeline.drain([&batch](T &result) { return batch(&result); });
+        batch(nullptr);
+        pipeline.record(*values, *source);
+      }
+      // Sets the parameter in the cell the bound copy shares with the
+      // pipeline it was bound from, and so for every copy of it too
+      template <typename V> Bound &Set(const string &name, const V &value) {
+        pipeline.Set(name, value);
+        return *this;
+      }
+      string Explain(const ExplainFormat &format = ExplainFormat::Text) const {
+        return pipeline.Explain(format);
+      }
+    };
+
     Composer() : first(nullptr), last(nullptr) {}
+    // Copies the stages, but not the cells of the named parameters, which
+    // the copied stages still read through the handles they captured: Set
+    // on a copy changes the parameter for the original too. A fork that
+    // needs a value of its own registers a parameter of its own.
     Composer(const Composer<T> &other) {
       auto copy = static_pointer_cast<Composer<T>>(other.deepCopy());
       first = move(copy->first);
       last = move(copy->last);
+      parameters = other.parameters;
+      cacheEntries = other.cacheEntries;
+      cacheSample = other.cacheSample;
+      cacheHasher = other.cacheHasher;
     }
     Composer<T> &operator=(const Composer<T> &other) {
       auto copy = static_pointer_cast<Composer<T>>(other.deepCopy());
       first = move(copy->first);
       last = move(copy->last);
+      parameters = other.parameters;
+      cacheEntries = other.cacheEntries;
+      cacheSample = other.cacheSample;
+      cacheHasher = other.cacheHasher;
+      cache.clear();
       return *this;
     }
     Composer(Composer<T> &&other) = default;
     Composer<T> &operator=(Composer<T> &&other) = default;
-    void clear() { first = last = nullptr; }
+    void clear() {
+      first = last = nullptr;
+      cache.clear();
+    }
+    // Appends a stage, or a pipeline whose parameters join this one's. A
+    // name both register must name the same cell, as it does for copies of
+    // one pipeline; two cells under one name would leave Set reaching only
+    // one of them.
     template <typename F> Composer<T> &append(F func) {
+      if constexpr (std::is_same_v<F, Composer<T>>) {
+        for (auto &parameter : func.parameters) {
+          auto found = parameters.find(parameter.first);
+          if (found != parameters.end() &&
+              found->second.value != parameter.second.value)
+            throw std::invalid_argument("parameter " + parameter.first +
+                                        " is registered by both pipelines");
+        }
+        parameters.insert(func.parameters.begin(), func.parameters.end());
+      }
+      cache.clear();
       shared_ptr<Functor<T>> temp = make_shared<F>(move(func));
       temp->setPreviousFunction(first);
       first = temp;
@@ -336,23 +2429,766 @@ namespace Pipeline {
         last = first;
       return *this;
     }
+    // Returns the parameter registered under name, registering it with
+    // initial as its value if there is none
+    template <typename V>
+    Parameter<V> Param(const string &name, const V &initial = V()) {
+      auto found = parameters.find(name);
+      if (found == parameters.end()) {
+        Parameter<V> parameter(initial);
+        parameters.emplace(
+            name,
+            Named{parameter.value, type_index(typeid(V)),
+                  [value = parameter.value]() -> uint64_t {
+                    return hashValue(*value);
+                  },
+                  [value = parameter.value, name](const std::any &from) {
+                    if constexpr (std::is_arithmetic_v<V>)
+                      return assignArithmetic<
+                          V, bool, char, signed char, unsigned char, short,
+                          unsigned short, int, unsigned, long, unsigned long,
+                          long long, unsigned long long, float, double,
+                          long double>(from, *value, name);
+                    else if constexpr (std::is_assignable_v<V &,
+                                                            const char *>) {
+                      if (auto text = std::any_cast<const char *>(&from)) {
+                        *value = *text;
+                        return true;
+                      }
+                    }
+                    return false;
+                  }});
+        return parameter;
+      }
+      if (found->second.type != type_index(typeid(V)))
+        throw std::invalid_argument("parameter " + name +
+                                    " has a different type");
+      return Parameter<V>(static_pointer_cast<V>(found->second.value));
+    }
+    // Sets the named parameter to value, converting an arithmetic value to
+    // the parameter's arithmetic type, or a string literal to a string
+    template <typename V> Composer<T> &Set(const string &name, const V &value) {
+      if constexpr (std::is_array_v<V>)
+        return Set<const std::remove_extent_t<V> *>(name, value);
+      else {
+        auto found = parameters.find(name);
+        if (found == parameters.end())
+          throw std::out_of_range("no parameter named " + name);
+        if (found->second.type == type_index(typeid(V)))
+          Param<V>(name).Set(value);
+        else if constexpr (std::is_copy_constructible_v<std::decay_t<V>>) {
+          if (!found->second.assign(std::any(value)))
+            throw std::invalid_argument("parameter " + name +
+                                        " has a different type");
+        } else
+          throw std::invalid_argument("parameter " + name +
+                                      " has a different type");
+        return *this;
+      }
+    }
     template <typename... Args> Composer<T> &Select(Args &&...args) {
       return append(Pipeline::Select<T>(args...));
     }
+    template <typename... Args> Composer<T> &SelectMemo(Args &&...args) {
+      return append(Pipeline::SelectMemo<T>(args...));
+    }
+    template <typename... Args> Composer<T> &SelectBatch(Args &&...args) {
+      return append(Pipeline::SelectBatch<T>(args...));
+    }
     template <typename... Args> Composer<T> &Take(Args &&...args) {
       return append(Pipeline::Take<T>(args...));
     }
     template <typename... Args> Composer<T> &OrderBy(Args &&...args) {
       return append(Pipeline::OrderBy<T>(args...));
     }
+    template <typename... Args> Composer<T> &OrderByKey(Args &&...args) {
+      return append(Pipeline::OrderByKey<T>(args...));
+    }
+    template <typename... Args>
+    Composer<T> &OrderByNormalized(Args &&...args) {
+      return append(Pipeline::OrderByNormalized<T>(args...));
+    }
     template <typename... Args> Composer<T> &Where(Args &&...args) {
       return append(Pipeline::Where<T>(args...));
     }
+    // Identifies the pipeline across processes by its row type, the
+    // signatures of its stages, the types of the functions given to them
+    // and its parameter values. Functions of one type, such as plain
+    // function pointers or a lambda capturing different values, are told
+    // apart only by what they read through parameters.
+    uint64_t Fingerprint() const {
+      vector<const Functor<T> *> stages;
+      flatten(stages);
+      string type = typeid(T).name();
+      uint64_t hash = hashBytes(type.data(), type.size());
+      for (auto stage = stages.rbegin(); stage != stages.rend(); ++stage) {
+        string signature = (*stage)->signature() + (*stage)->callable();
+        hash = hashCombine(hash,
+                           hashBytes(signature.data(), signature.size()));
+      }
+      return hashCombine(hash, hashParameters());
+    }
+    // Keeps the results of the last entries runs of ToList, and returns a
+    // copy of them when an input with the same content comes again under the
+    // same parameter values. With sample rows, only that many rows spread
+    // over a larger input are hashed, which is as good as the caller's
+    // knowledge that inputs differing elsewhere do not come. The stages
+    // must not depend on anything but their input and parameters.
+    // Entries of 0 turns caching off; appending a stage clears the cache.
+    Composer<T> &Cache(const size_t &entries = 16, const size_t &sample = 0) {
+      static_assert(HashableValue<T>,
+                    "rows cached by their content must be hashable; give "
+                    "Cache a hasher");
+      cacheEntries = entries;
+      cacheSample = sample;
+      cacheHasher = nullptr;
+      cache.clear();
+      return *this;
+    }
+    // Caches rows that neither std::hash nor their bytes can hash, hashing
+    // each input row with hasher
+    Composer<T> &Cache(const function<uint64_t(const T &)> &hasher,
+                       const size_t &entries = 16, const size_t &sample = 0) {
+      cacheEntries = entries;
+      cacheSample = sample;
+      cacheHasher = hasher;
+      cache.clear();
+      return *this;
+    }
+    // Rows of a source stage cannot be hashed up front, so its runs are
+    // cached only when versioned
     template <typename C> inline vector<T> ToList(const C &values) {
+      if constexpr (!std::is_base_of_v<Functor<T>, C>)
+        if (cacheEntries)
+          return cached(values, hashInput(values));
       return preprocess(values);
     }
     inline vector<T> ToList(const initializer_list<T> &values) {
-      return preprocess(values);
+      return ToList<initializer_list<T>>(values);
+    }
+    // Caches by version in place of the input's content: the caller vouches
+    // that inputs given the same version have the same content
+    template <typename C>
+    inline vector<T> ToList(const C &values, const uint64_t &version) {
+      if (!cacheEntries)
+        return preprocess(values);
+      return cached(values, hashCombine(0x76657273696f6eull, version));
+    }
+    // Hands every output row to callback as it is produced, without
+    // materializing the results. A callback returning bool stops the run
+    // when it returns false.
+    template <typename C, typename F>
+    inline void ForEach(const C &values, F callback) {
+      process(values,
+              [&callback](T &result) { return proceed(callback, result); });
+    }
+    template <typename F>
+    inline void ForEach(const initializer_list<T> &values, F callback) {
+      ForEach<initializer_list<T>>(values, move(callback));
+    }
+    // Like ForEach, handing the rows over in spans of up to size rows from a
+    // buffer that is reused between batches
+    template <typename C, typename F>
+    inline void ForEachBatch(const C &values, F callback, const size_t &size) {
+      auto batch = batches(callback, size);
+      process(values, [&batch](T &result) { return batch(&result); });
+      batch(nullptr);
+    }
+    template <typename F>
+    inline void ForEachBatch(const initializer_list<T> &values, F callback,
+                             const size_t &size) {
+      ForEachBatch<initializer_list<T>>(values, move(callback), size);
+    }
+    // Splits the output in one run into the rows that satisfy predicate and
+    // the rows that do not, each in output order
+    template <typename C, typename F>
+    std::pair<vector<T>, vector<T>> Partition(const C &values, F predicate) {
+      std::pair<vector<T>, vector<T>> results;
+      process(values, [&](T &result) {
+        (predicate(static_cast<const T &>(result)) ? results.first
+                                                   : results.second)
+            .emplace_back(move(result));
+        return true;
+      });
+      return results;
+    }
+    // Runs this pipeline once and hands its output to every branch, a
+    // pipeline of its own, returning their results in order. The branches
+    // run as with MultiQuery, reading the output through a bounded ring
+    // rather than from a materialized copy, on up to threads threads. By
+    // default they all run on the calling thread; with more threads, the
+    // functions of the branches must be safe to call concurrently.
+    template <typename C>
+    vector<vector<T>> Tee(const C &values, const vector<Composer<T>> &branches,
+                          const size_t &threads = 1) const {
+      MultiQuery<T> query(branches, 4096, 4, threads);
+      if (!first)
+        return query.ToList(values);
+      Composer<T> upstream(*this);
+      upstream.last->setPreviousFunction(makeSource<T>(values));
+      return query.ToList(upstream);
+    }
+    // The positional terminals below read only the rows they need when the
+    // pipeline is made of Select and Take over a container with
+    // bidirectional iterators, and run it in full otherwise. Selects are
+    // then called once per row returned, so they must have no side effects.
+    template <typename C> vector<T> Reverse(const C &values) {
+      if constexpr (bidirectional<C>()) {
+        vector<const Functor<T> *> stages;
+        size_t rows = std::distance(cbegin(values), cend(values)),
+               length = rows;
+        if (direct(length, stages)) {
+          vector<T> results;
+          results.reserve(length);
+          for (auto it = std::prev(cend(values), rows - length); length;
+               --length)
+            results.push_back(map(*--it, stages));
+          return results;
+        }
+      }
+      auto results = preprocess(values);
+      std::reverse(results.begin(), results.end());
+      return results;
+    }
+    template <typename C> T Last(const C &values) {
+      if constexpr (bidirectional<C>()) {
+        vector<const Functor<T> *> stages;
+        size_t rows = std::distance(cbegin(values), cend(values)),
+               length = rows;
+        if (direct(length, stages)) {
+          if (!length)
+            throw std::out_of_range("Last of an empty result");
+          return map(*std::prev(cend(values), rows - length + 1), stages);
+        }
+      }
+      unique_ptr<T> found;
+      process(values, [&found](T &result) {
+        if (found)
+          *found = move(result);
+        else
+          found = make_unique<T>(move(result));
+        return true;
+      });
+      if (!found)
+        throw std::out_of_range("Last of an empty result");
+      return move(*found);
+    }
+    template <typename C> T ElementAt(const C &values, const size_t &index) {
+      if constexpr (bidirectional<C>()) {
+        vector<const Functor<T> *> stages;
+        size_t length = std::distance(cbegin(values), cend(values));
+        if (direct(length, stages)) {
+          if (index >= length)
+            throw std::out_of_range("no row at index " + to_string(index));
+          return map(*std::next(cbegin(values), index), stages);
+        }
+      }
+      unique_ptr<T> found;
+      size_t position = 0;
+      process(values, [&](T &result) {
+        if (position++ < index)
+          return true;
+        found = make_unique<T>(move(result));
+        return false;
+      });
+      if (!found)
+        throw std::out_of_range("no row at index " + to_string(index));
+      return move(*found);
+    }
+    // Count and Any skip the stages that cannot change the number of rows
+    // after the last filter, and read no rows at all when there is none
+    template <typename C> size_t Count(const C &values) {
+      return cardinality(values, std::numeric_limits<size_t>::max());
+    }
+    template <typename C> bool Any(const C &values) {
+      return cardinality(values, 1) > 0;
+    }
+    // Runs the pipeline over every container of inputs, paying for the
+    // source wiring and result allocation once rather than per input. With
+    // several threads the inputs are split into contiguous ranges, each run
+    // by its own copy of the pipeline, so the functions given to the stages
+    // must be safe to call concurrently.
+    template <typename R>
+    vector<vector<T>> ToListMany(const R &inputs, size_t threads = 1) {
+      using C = std::decay_t<decltype(*cbegin(inputs))>;
+      vector<const C *> items;
+      for (auto it = cbegin(inputs); it != cend(inputs); ++it)
+        items.push_back(&*it);
+      vector<vector<T>> results(items.size());
+      if (items.empty())
+        return results;
+      threads = std::max<size_t>(1, std::min(threads, items.size()));
+      vector<std::thread> workers;
+      vector<std::exception_ptr> errors(threads);
+      vector<Composer<T>> copies(threads - 1, *this);
+      auto bound = [&](const size_t &worker) {
+        return items.size() * worker / threads;
+      };
+      for (size_t worker = 1; worker < threads; ++worker)
+        workers.emplace_back([&, worker]() {
+          try {
+            copies[worker - 1].processMany(items, results, bound(worker),
+                                           bound(worker + 1));
+          } catch (...) {
+            errors[worker] = std::current_exception();
+          }
+        });
+      try {
+        processMany(items, results, 0, bound(1));
+      } catch (...) {
+        errors[0] = std::current_exception();
+      }
+      for (auto &worker : workers)
+        worker.join();
+      for (auto &error : errors)
+        if (error)
+          std::rethrow_exception(error);
+      execution = threads > 1 ? "batch (" + to_string(threads) + " threads)"
+                              : "batch";
+      return results;
+    }
+    // The bound query refers to values, which must outlive it
+    template <typename C> inline Bound<C> Bind(const C &values) const {
+      return Bound<C>(*this, values);
+    }
+    template <typename C> void Bind(const C &&values) const = delete;
+    // Describes the stage chain from source to output, with estimated rows
+    // and cost per stage scaled from inputRows and the rows each stage
+    // actually produced in the last run.
+    string Explain(const size_t &inputRows,
+                   const ExplainFormat &format = ExplainFormat::Text) const {
+      vector<const Functor<T> *> stages;
+      flatten(stages);
+      std::reverse(stages.begin(), stages.end());
+      double rows = inputRows, total = rows;
+      vector<double> estimates{rows}, costs{rows};
+      for (auto stage : stages) {
+        costs.push_back(stage->cost(rows));
+        total += costs.back();
+        estimates.push_back(rows = stage->estimate(rows));
+      }
+      ostringstream out;
+      auto actual = [&](const size_t &index) -> string {
+        if (!executed)
+          return format == ExplainFormat::Json ? "null" : "-";
+        return to_string(index ? stages[index - 1]->produced : inputRead);
+      };
+      auto name = [&](const size_t &index) -> string {
+        return index ? stages[index - 1]->describe() : origin;
+      };
+      if (format == ExplainFormat::Json) {
+        out << "{\"execution\":\"" << execution << "\",\"inputRows\":" << inputRows
+            << ",\"stages\":[";
+        for (size_t i = 0; i < estimates.size(); ++i)
+          out << (i ? "," : "") << "{\"stage\":\"" << name(i)
+              << "\",\"estimatedRows\":" << std::llround(estimates[i])
+              << ",\"estimatedCost\":" << std::llround(costs[i])
+              << ",\"actualRows\":" << actual(i) << "}";
+        out << "],\"estimatedCost\":" << std::llround(total) << "}";
+        return out.str();
+      }
+      int width = 24;
+      for (size_t i = 0; i < estimates.size(); ++i)
+        width = std::max(width, static_cast<int>(name(i).size()) + 2);
+      out << "execution: " << execution << '\n'
+          << std::left << std::setw(width) << "stage" << std::right
+          << std::setw(14) << "est.rows" << std::setw(14) << "est.cost"
+          << std::setw(14) << "actual.rows" << '\n';
+      for (size_t i = 0; i < estimates.size(); ++i)
+        out << std::left << std::setw(width) << name(i) << std::right
+            << std::setw(14) << std::llround(estimates[i]) << std::setw(14)
+            << std::llround(costs[i]) << std::setw(14) << actual(i) << '\n';
+      out << std::left << std::setw(width + 14) << "total" << std::right
+          << std::setw(14) << std::llround(total) << '\n';
+      return out.str();
+    }
+    // Estimates are scaled from the size of the last input
+    string Explain(const ExplainFormat &format = ExplainFormat::Text) const {
+      return Explain(inputRows, format);
+    }
+  };
+
+  // Runs several pipelines over a single pass of a source: the source is
+  // read once into a ring of blocks of up to size rows, which every
+  // pipeline reads from while the blocks are still in cache. A block is
+  // refilled once every pipeline is past it, so a pipeline that falls
+  // behind holds back the others by at most the ring. When the pipelines
+  // are forks of one another, the leading stages they all share run once,
+  // and the ring holds their output instead.
+  // The pipelines are split among up to threads workers, the calling thread
+  // being one, each running its pipelines over a block in turn. The stages
+  // that can be paused at the end of a block, such as Select, Where and
+  // Take, run block by block; from the first stage that cannot, e.g. one
+  // that sorts, a pipeline's rows are buffered, and the rest of it runs
+  // over the buffer on the same worker once the scan has ended. With one
+  // thread, everything runs on the calling thread.
+  // The functions given to the stages must be safe to call concurrently.
+  template <typename T> class MultiQuery {
+    // the ring shared by the readers of one run
+    struct Scan {
+      vector<vector<T>> ring;
+      // blocks written so far, and whether the source is exhausted
+      size_t written = 0;
+      bool finished = false;
+      // the block each reader is at, and whether it stopped reading
+      vector<size_t> cursors;
+      vector<char> stopped;
+      std::mutex mutex;
+      std::condition_variable changed;
+
+      // whether no reader still needs the block that block would replace
+      bool writable(const size_t &block) const {
+        for (size_t index = 0; index < cursors.size(); ++index)
+          if (!stopped[index] && cursors[index] + ring.size() <= block)
+            return false;
+        return true;
+      }
+      bool abandoned() const {
+        return std::all_of(stopped.begin(), stopped.end(),
+                           [](const char &value) { return value; });
+      }
+      void advance(const size_t &reader, const size_t &block) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          cursors[reader] = block;
+        }
+        changed.notify_all();
+      }
+      void stop(const size_t &reader) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          stopped[reader] = true;
+        }
+        changed.notify_all();
+      }
+      // Waits until block is written, returning false once it never will be
+      bool await(const size_t &block) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return written > block || finished; });
+        return written > block;
+      }
+    };
+
+    // The source of a pipeline run by a worker: it yields the rows of the
+    // block it was handed and then nullptr, which pauses the pipeline until
+    // the next block, or ends it once the scan has ended
+    class Feed : public Functor<T> {
+      const vector<T> *rows = nullptr;
+      size_t position = 0;
+      bool ended = false, paused = false;
+
+    public:
+      void setPreviousFunction(shared_ptr<Functor<T>>) {}
+      shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+      shared_ptr<Functor<T>> deepCopy() const {
+        return make_shared<Feed>(*this);
+      }
+      void open() {
+        rows = nullptr;
+        position = 0;
+        ended = paused = false;
+        this->produced = 0;
+      }
+      inline unique_ptr<T> next() {
+        if (rows != nullptr && position < rows->size()) {
+          ++this->produced;
+          return make_unique<T>((*rows)[position++]);
+        }
+        paused = !ended;
+        return nullptr;
+      }
+      void close() {}
+      string describe() const { return "Shared scan"; }
+      inline void hand(const vector<T> *rows) {
+        this->rows = rows;
+        position = 0;
+        ended = rows == nullptr;
+        paused = false;
+      }
+      // whether the pipeline stopped for want of rows rather than for good
+      inline bool waiting() const { return paused; }
+    };
+
+    // A pipeline run by a worker; output, the last stage run block by
+    // block, is null when there is none past the shared prefix, and takes
+    // the rows as they are. cut is the first stage that cannot be paused,
+    // if any, whose input is buffered until the scan has ended.
+    struct Member {
+      size_t index;
+      Functor<T> *output;
+      shared_ptr<Feed> feed;
+      bool done;
+      Functor<T> *cut;
+      vector<T> buffer;
+    };
+
+    vector<Composer<T>> pipelines;
+    size_t size, blocks, threads;
+
+    template <typename C> static inline auto begin(const C &values) {
+      if constexpr (std::is_base_of_v<Functor<T>, C>)
+        return nullptr;
+      else
+        return cbegin(values);
+    }
+
+  public:
+    MultiQuery(const size_t &size = 4096, const size_t &blocks = 4,
+               const size_t &threads = std::thread::hardware_concurrency())
+        : size(std::max<size_t>(size, 1)), blocks(std::max<size_t>(blocks, 2)),
+          threads(std::max<size_t>(threads, 1)) {}
+    MultiQuery(const vector<Composer<T>> &pipelines, const size_t &size = 4096,
+               const size_t &blocks = 4,
+               const size_t &threads = std::thread::hardware_concurrency())
+        : MultiQuery(size, blocks, threads) {
+      this->pipelines = pipelines;
+    }
+    MultiQuery<T> &Add(const Composer<T> &pipeline) {
+      pipelines.push_back(pipeline);
+      return *this;
+    }
+    // the copy of a pipeline that was added, for e.g. Explain or Set
+    Composer<T> &operator[](const size_t &index) { return pipelines[index]; }
+    const Composer<T> &operator[](const size_t &index) const {
+      return pipelines[index];
+    }
+    // Returns the results of every pipeline, in the order they were added
+    template <typename C> vector<vector<T>> ToList(const C &values) {
+      vector<vector<T>> results(pipelines.size());
+      if (pipelines.empty())
+        return results;
+      // the stages of every pipeline from input to output, and how many
+      // leading ones all of them share
+      vector<vector<const Functor<T> *>> stages(pipelines.size());
+      for (size_t index = 0; index < pipelines.size(); ++index) {
+        pipelines[index].flatten(stages[index]);
+        std::reverse(stages[index].begin(), stages[index].end());
+      }
+      size_t shared = pipelines.size() > 1 ? stages[0].size() : 0;
+      for (auto &chain : stages) {
+        size_t common = 0;
+        while (common < std::min(shared, chain.size()) &&
+               chain[common]->lineage == stages[0][common]->lineage)
+          ++common;
+        shared = common;
+      }
+      // the stages are the pipelines' own, and this is not const
+      auto stage = [&stages](const size_t &index, const size_t &position) {
+        return const_cast<Functor<T> *>(stages[index][position]);
+      };
+      // the pipelines go to the workers, round robin
+      vector<vector<Member>> groups(std::min(threads, pipelines.size()));
+      for (size_t index = 0; index < pipelines.size(); ++index)
+        groups[index % groups.size()].push_back(
+            {index, nullptr, nullptr, false, nullptr, {}});
+      auto scan = make_shared<Scan>();
+      scan->ring.resize(blocks);
+      scan->cursors.assign(groups.size(), 0);
+      scan->stopped.assign(groups.size(), false);
+      auto source = makeSource<T>(values);
+      auto it = begin(values);
+      // a pipeline without stages reads the ring itself, and leaves no
+      // prefix to share
+      Functor<T> *prefix = nullptr;
+      shared_ptr<Functor<T>> base;
+      if (shared > 0) {
+        prefix = stage(0, shared - 1);
+        base = pipelines[0].last->getPreviousFunction();
+        pipelines[0].last->setPreviousFunction(source);
+      }
+      // every suffix reads the ring in place of its own prefix, up to the
+      // first stage that cannot be paused
+      vector<shared_ptr<Functor<T>>> inputs(pipelines.size());
+      vector<std::exception_ptr> errors(pipelines.size() + 1);
+      for (auto &group : groups)
+        for (auto &member : group) {
+          auto &chain = stages[member.index];
+          size_t cut = shared;
+          while (cut < chain.size() && chain[cut]->resumable())
+            ++cut;
+          if (cut < chain.size())
+            member.cut = stage(member.index, cut);
+          if (shared < cut) {
+            inputs[member.index] =
+                stage(member.index, shared)->getPreviousFunction();
+            member.feed = make_shared<Feed>();
+            stage(member.index, shared)->setPreviousFunction(member.feed);
+            member.output = stage(member.index, cut - 1);
+          }
+        }
+      // Runs the stages of a member from its cut on over the rows buffered
+      // below it, and then wires the cut back to its own input
+      auto complete = [&](Member &member) {
+        auto below = member.cut->getPreviousFunction();
+        member.cut->setPreviousFunction(makeSource<T>(member.buffer));
+        auto &top = *pipelines[member.index].first;
+        try {
+          top.open();
+          while (auto result = top.next())
+            results[member.index].emplace_back(move(*result));
+        } catch (...) {
+          errors[member.index] = std::current_exception();
+        }
+        top.close();
+        member.cut->setPreviousFunction(below);
+        vector<T>().swap(member.buffer);
+      };
+      // Runs the pipelines of a group over rows, or ends them when rows is
+      // null, returning whether any of them wants more rows
+      auto feed = [&](vector<Member> &group, const vector<T> *rows) {
+        bool live = false;
+        for (auto &member : group) {
+          if (member.done)
+            continue;
+          auto &output =
+              member.cut ? member.buffer : results[member.index];
+          if (member.output == nullptr) {
+            if (rows != nullptr)
+              output.insert(output.end(), rows->begin(), rows->end());
+            member.done = rows == nullptr;
+            if (member.done && member.cut)
+              complete(member);
+            live |= !member.done;
+            continue;
+          }
+          try {
+            member.feed->hand(rows);
+            while (auto result = member.output->next())
+              output.emplace_back(move(*result));
+            member.done = !member.feed->waiting();
+          } catch (...) {
+            errors[member.index] = std::current_exception();
+            member.done = true;
+          }
+          if (member.done) {
+            member.output->close();
+            if (member.cut && !errors[member.index])
+              complete(member);
+          }
+          live |= !member.done;
+        }
+        return live;
+      };
+      // opens the pipelines of a group before its first block
+      auto open = [&](vector<Member> &group) {
+        for (auto &member : group)
+          if (member.output != nullptr) {
+            try {
+              member.output->open();
+            } catch (...) {
+              errors[member.index] = std::current_exception();
+              member.done = true;
+              member.output->close();
+            }
+          }
+      };
+      vector<std::thread> workers;
+      for (size_t reader = 1; reader < groups.size(); ++reader)
+        workers.emplace_back([&, reader]() {
+          auto &group = groups[reader];
+          open(group);
+          for (size_t block = 0; scan->await(block); ++block) {
+            if (!feed(group, &scan->ring[block % blocks]))
+              break;
+            scan->advance(reader, block + 1);
+          }
+          feed(group, nullptr);
+          scan->stop(reader);
+        });
+      // the calling thread writes the ring, and runs the first group over
+      // every block it writes
+      open(groups[0]);
+      bool reading = std::any_of(groups[0].begin(), groups[0].end(),
+                                 [](const Member &member) {
+                                   return !member.done;
+                                 });
+      if (!reading)
+        scan->stop(0);
+      auto &input = prefix != nullptr ? *prefix : *source;
+      try {
+        input.open();
+        for (size_t block = 0;; ++block) {
+          {
+            std::unique_lock<std::mutex> lock(scan->mutex);
+            scan->changed.wait(lock, [&] {
+              return scan->abandoned() || scan->writable(block);
+            });
+            if (scan->abandoned())
+              break;
+          }
+          auto &rows = scan->ring[block % blocks];
+          rows.clear();
+          // a container is copied from directly, without a row allocation
+          if constexpr (!std::is_base_of_v<Functor<T>, C>) {
+            if (prefix == nullptr) {
+              for (; rows.size() < size && it != cend(values); ++it)
+                rows.push_back(*it);
+              source->produced += rows.size();
+            }
+          }
+          if (prefix != nullptr || std::is_base_of_v<Functor<T>, C>) {
+            while (rows.size() < size)
+              if (auto result = input.next())
+                rows.emplace_back(move(*result));
+              else
+                break;
+          }
+          bool last = rows.size() < size;
+          {
+            std::lock_guard<std::mutex> lock(scan->mutex);
+            if (!rows.empty())
+              ++scan->written;
+            scan->finished = last;
+          }
+          scan->changed.notify_all();
+          if (reading && !rows.empty()) {
+            reading = feed(groups[0], &rows);
+            if (reading)
+              scan->advance(0, block + 1);
+            else
+              scan->stop(0);
+          }
+          if (last)
+            break;
+        }
+        input.close();
+      } catch (...) {
+        errors.back() = std::current_exception();
+        input.close();
+      }
+      {
+        std::lock_guard<std::mutex> lock(scan->mutex);
+        scan->finished = true;
+      }
+      scan->changed.notify_all();
+      feed(groups[0], nullptr);
+      for (auto &worker : workers)
+        worker.join();
+      for (size_t index = 0; index < pipelines.size(); ++index)
+        if (inputs[index] != nullptr)
+          stage(index, shared)->setPreviousFunction(inputs[index]);
+      if (shared > 0)
+        pipelines[0].last->setPreviousFunction(base);
+      for (auto &error : errors)
+        if (error)
+          std::rethrow_exception(error);
+      // the prefix ran once, through the stages of the first pipeline, and
+      // the others report its counts as their own
+      for (size_t index = 1; index < pipelines.size(); ++index)
+        for (size_t position = 0; position < shared; ++position)
+          stage(index, position)->produced = stages[0][position]->produced;
+      string execution = "shared scan (";
+      if (shared > 0)
+        execution += "shared prefix: " + to_string(shared) + ", ";
+      execution += to_string(groups.size()) + " threads)";
+      for (auto &pipeline : pipelines) {
+        pipeline.record(values, *source);
+        pipeline.execution = execution;
+      }
+      return results;
+    }
+    inline vector<vector<T>> ToList(const initializer_list<T> &values) {
+      return ToList<initializer_list<T>>(values);
     }
   };
 
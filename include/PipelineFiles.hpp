@@ -0,0 +1,362 @@
+#pragma once
+
+// ReadFiles, a source of rows read from files, kept out of Pipeline.hpp so
+// that only its users pull in the system headers it reads through
+
+#include "Pipeline.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+
+// io_uring and IORING_OP_READ came with the 5.6 kernel headers
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) &&                \
+    __has_include(<linux/version.h>)
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define PIPELINE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace Pipeline {
+
+#if defined(PIPELINE_IO_URING)
+  // A minimal io_uring over the raw system calls, as liburing is not assumed
+  // to be installed. Each read is tagged with the index of the block it
+  // reads into.
+  class IoRing {
+    int fd = -1;
+    void *sq = MAP_FAILED, *cq = MAP_FAILED, *sqes = MAP_FAILED;
+    size_t sqBytes = 0, cqBytes = 0, sqesBytes = 0;
+    unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    // reads queued but not yet handed to the kernel
+    unsigned queued = 0;
+    bool fixed = false;
+
+  public:
+    IoRing() = default;
+    IoRing(const IoRing &other) = delete;
+    IoRing &operator=(const IoRing &other) = delete;
+    ~IoRing() { reset(); }
+    bool ready() const { return fd >= 0; }
+    // Sets up a ring for up to depth reads into the blocks of buffer, which
+    // are registered with the kernel when the memory lock limit allows it;
+    // returns false when io_uring is not available
+    bool setup(const unsigned &depth, char *buffer, const size_t &block) {
+      reset();
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+      fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+      if (fd < 0)
+        return false;
+      sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+      auto map = [this](const size_t &bytes, const off_t &offset) {
+        return mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, offset);
+      };
+      sq = map(sqBytes, IORING_OFF_SQ_RING);
+      cq = map(cqBytes, IORING_OFF_CQ_RING);
+      sqes = map(sqesBytes, IORING_OFF_SQES);
+      if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        reset();
+        return false;
+      }
+      auto field = [](void *base, const unsigned &offset) {
+        return reinterpret_cast<unsigned *>(static_cast<char *>(base) + offset);
+      };
+      sqTail = field(sq, params.sq_off.tail);
+      sqMask = field(sq, params.sq_off.ring_mask);
+      sqArray = field(sq, params.sq_off.array);
+      cqHead = field(cq, params.cq_off.head);
+      cqTail = field(cq, params.cq_off.tail);
+      cqMask = field(cq, params.cq_off.ring_mask);
+      cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(cq) +
+                                              params.cq_off.cqes);
+      vector<iovec> blocks(depth);
+      for (unsigned index = 0; index < depth; ++index)
+        blocks[index] = {buffer + index * block, block};
+      fixed = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                      blocks.data(), depth) == 0;
+      return true;
+    }
+    void reset() {
+      if (sq != MAP_FAILED)
+        munmap(sq, sqBytes);
+      if (cq != MAP_FAILED)
+        munmap(cq, cqBytes);
+      if (sqes != MAP_FAILED)
+        munmap(sqes, sqesBytes);
+      sq = cq = sqes = MAP_FAILED;
+      if (fd >= 0)
+        ::close(fd);
+      fd = -1;
+      queued = 0;
+    }
+    // Queues a read of length bytes at offset of file into block index,
+    // which starts at into
+    void read(const int &file, const uint64_t &offset, char *into,
+              const unsigned &length, const unsigned &index) {
+      unsigned tail = *sqTail, slot = tail & *sqMask;
+      auto &entry = static_cast<io_uring_sqe *>(sqes)[slot];
+      std::memset(&entry, 0, sizeof(entry));
+      entry.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+      entry.fd = file;
+      entry.off = offset;
+      entry.addr = reinterpret_cast<uint64_t>(into);
+      entry.len = length;
+      if (fixed)
+        entry.buf_index = static_cast<uint16_t>(index);
+      entry.user_data = index;
+      sqArray[slot] = slot;
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+      ++queued;
+    }
+    // Hands the queued reads to the kernel and waits for one to complete,
+    // reporting its block and its result: the bytes read or -errno
+    bool wait(unsigned &index, int &result) {
+      while (true) {
+        unsigned head = *cqHead;
+        if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+          auto &entry = cqes[head & *cqMask];
+          index = static_cast<unsigned>(entry.user_data);
+          result = entry.res;
+          __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+          return true;
+        }
+        long submitted = syscall(__NR_io_uring_enter, fd, queued, 1,
+                                 IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted < 0) {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+        queued -= std::min<unsigned>(queued, submitted);
+      }
+    }
+  };
+#endif
+
+  // Reads files of rows stored as their raw bytes, one file after the
+  // other, keeping up to depth reads of block bytes in flight. On Linux the
+  // reads go through io_uring into registered buffers; elsewhere, or when
+  // io_uring is not available, every block is read with fread as it is
+  // requested. Trailing bytes that do not make up a whole row are skipped.
+  template <typename T> class ReadFiles : public Functor<T> {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "ReadFiles reads rows as their raw bytes");
+
+    struct Slot {
+      size_t file;
+      uint64_t offset;
+      size_t length, filled;
+      // whether the slot holds a read, whether the read completed, and
+      // whether it is the last one of its file
+      bool active, done, last;
+    };
+
+    vector<string> paths;
+    size_t block, depth;
+    vector<char> buffer;
+    vector<Slot> slots;
+    vector<std::FILE *> files;
+    // where the next read starts, and the size of the file it is in
+    size_t file;
+    uint64_t offset, size;
+    // the slot being read and the next byte in it
+    size_t head, position, inflight;
+    bool uring;
+#if defined(PIPELINE_IO_URING)
+    IoRing ring;
+
+    // Reads what io_uring did not, e.g. after a short read
+    static size_t readAt(const int &file, char *into, const size_t &length,
+                         uint64_t offset) {
+      size_t total = 0;
+      while (total < length) {
+        ssize_t read = pread(file, into + total, length - total,
+                             static_cast<off_t>(offset + total));
+        if (read < 0 && errno == EINTR)
+          continue;
+        if (read <= 0)
+          break;
+        total += read;
+      }
+      return total;
+    }
+#endif
+
+    // Assigns the next block of the files to slot index and starts reading it
+    void request(const size_t &index) {
+      auto &slot = slots[index];
+      slot.active = false;
+      while (file < paths.size()) {
+        if (files[file] == nullptr) {
+          files[file] = std::fopen(paths[file].c_str(), "rb");
+          if (files[file] == nullptr)
+            throw std::runtime_error("cannot open " + paths[file]);
+          size = std::filesystem::file_size(paths[file]);
+          offset = 0;
+        }
+        uint64_t rows = (size - offset) / sizeof(T);
+        if (rows > 0) {
+          slot = {file,
+                  offset,
+                  static_cast<size_t>(
+                      std::min<uint64_t>(rows * sizeof(T), block)),
+                  0,
+                  true,
+                  false,
+                  false};
+          offset += slot.length;
+          // the file is closed once its last block has been read
+          slot.last = (size - offset) / sizeof(T) == 0;
+          if (slot.last)
+            ++file;
+          break;
+        }
+        std::fclose(files[file]);
+        files[file] = nullptr;
+        ++file;
+      }
+      if (!slot.active)
+        return;
+      char *into = buffer.data() + index * block;
+#if defined(PIPELINE_IO_URING)
+      if (uring) {
+        ring.read(fileno(files[slot.file]), slot.offset, into,
+                  static_cast<unsigned>(slot.length),
+                  static_cast<unsigned>(index));
+        ++inflight;
+        return;
+      }
+#endif
+      slot.filled = std::fread(into, 1, slot.length, files[slot.file]);
+      if (slot.filled < slot.length)
+        throw std::runtime_error("cannot read " + paths[slot.file]);
+      slot.done = true;
+    }
+    // Waits until the read of the head slot completes
+    void complete() {
+#if defined(PIPELINE_IO_URING)
+      while (!slots[head].done) {
+        unsigned index;
+        int result;
+        if (!ring.wait(index, result))
+          throw std::runtime_error("io_uring_enter failed");
+        --inflight;
+        auto &slot = slots[index];
+        slot.done = true;
+        slot.filled = result > 0 ? result : 0;
+        if (slot.filled < slot.length)
+          slot.filled += readAt(fileno(files[slot.file]),
+                                buffer.data() + index * block + slot.filled,
+                                slot.length - slot.filled,
+                                slot.offset + slot.filled);
+        if (slot.filled < slot.length)
+          throw std::runtime_error("cannot read " + paths[slot.file]);
+      }
+#endif
+    }
+
+  public:
+    ReadFiles(const vector<string> &paths, const size_t &block = 1 << 20,
+              const size_t &depth = 4)
+        : paths(paths),
+          block(std::max<size_t>(block / sizeof(T), 1) * sizeof(T)),
+          depth(std::max<size_t>(depth, 1)), file(0), offset(0), size(0),
+          head(0), position(0), inflight(0), uring(false) {}
+    ReadFiles(const ReadFiles<T> &other)
+        : ReadFiles(other.paths, other.block, other.depth) {}
+    ReadFiles<T> &operator=(const ReadFiles<T> &other) {
+      close();
+      paths = other.paths;
+      block = other.block;
+      depth = other.depth;
+      buffer.clear();
+#if defined(PIPELINE_IO_URING)
+      ring.reset();
+#endif
+      return *this;
+    }
+    // reads still in flight must land before the buffer is freed
+    ~ReadFiles() { close(); }
+    void setPreviousFunction(shared_ptr<Functor<T>>) {}
+    shared_ptr<Functor<T>> getPreviousFunction() const { return nullptr; }
+    shared_ptr<Functor<T>> deepCopy() const {
+      return make_shared<ReadFiles<T>>(*this);
+    }
+    void open() {
+      close();
+      if (buffer.size() != depth * block) {
+        buffer.assign(depth * block, 0);
+#if defined(PIPELINE_IO_URING)
+        ring.reset();
+#endif
+      }
+#if defined(PIPELINE_IO_URING)
+      uring = ring.ready() ||
+              ring.setup(static_cast<unsigned>(depth), buffer.data(), block);
+#endif
+      files.assign(paths.size(), nullptr);
+      slots.assign(depth, Slot());
+      file = 0;
+      head = position = 0;
+      this->produced = 0;
+      for (size_t index = 0; index < depth; ++index)
+        request(index);
+    }
+    inline unique_ptr<T> next() {
+      while (true) {
+        auto &slot = slots[head];
+        if (!slot.active)
+          return nullptr;
+        if (!slot.done)
+          complete();
+        if (position + sizeof(T) <= slot.filled) {
+          auto result = make_unique<T>();
+          std::memcpy(static_cast<void *>(result.get()),
+                      buffer.data() + head * block + position, sizeof(T));
+          position += sizeof(T);
+          ++this->produced;
+          return result;
+        }
+        if (slot.last) {
+          std::fclose(files[slot.file]);
+          files[slot.file] = nullptr;
+        }
+        request(head);
+        head = (head + 1) % depth;
+        position = 0;
+      }
+    }
+    void close() {
+#if defined(PIPELINE_IO_URING)
+      for (unsigned index; inflight > 0; --inflight) {
+        int result;
+        if (!ring.wait(index, result))
+          break;
+      }
+#endif
+      inflight = 0;
+      for (auto &handle : files)
+        if (handle != nullptr)
+          std::fclose(handle);
+      files.clear();
+      slots.clear();
+    }
+    string describe() const {
+      return "ReadFiles(" + to_string(paths.size()) + " files" +
+             (uring ? ", io_uring" : "") + ")";
+    }
+  };
+
+} // namespace Pipeline
@@ -0,0 +1,153 @@
+#pragma once
+
+// Persist and Materialize, which write the results of a pipeline to a file
+// and map them back, kept out of Pipeline.hpp so that only their users
+// pull in the system headers they map through
+
+#include "Pipeline.hpp"
+
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PIPELINE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(PIPELINE_MMAP)
+namespace Pipeline {
+
+  // The start of a file of results persisted by Persist; the rows
+  // follow from byte MappedResults::offset on
+  struct ResultsHeader {
+    char magic[8];
+    uint32_t format, rowSize;
+    uint64_t count, fingerprint, version;
+  };
+
+  // A read-only view of persisted results, mapped from their file for as
+  // long as the view lives, so that they are usable without being read
+  template <typename T> class MappedResults {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "persisted rows are mapped as their raw bytes");
+    static_assert(alignof(T) <= 64, "rows are mapped from byte 64 on");
+
+    void *base = MAP_FAILED;
+    size_t bytes = 0;
+    ResultsHeader header;
+
+  public:
+    static constexpr char magic[8] = {'P', 'I', 'P', 'E', 'R', 'O', 'W', 'S'};
+    static constexpr uint32_t format = 1;
+    static constexpr size_t offset = 64;
+
+    // Throws std::runtime_error when path cannot be mapped or does not hold
+    // rows of this size
+    explicit MappedResults(const string &path) {
+      int file = ::open(path.c_str(), O_RDONLY);
+      if (file < 0)
+        throw std::runtime_error("cannot open " + path);
+      struct stat status;
+      if (fstat(file, &status) == 0 &&
+          static_cast<size_t>(status.st_size) >= offset) {
+        bytes = status.st_size;
+        base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, file, 0);
+      }
+      ::close(file);
+      if (base == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path);
+      std::memcpy(&header, base, sizeof(header));
+      if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+          header.format != format || header.rowSize != sizeof(T) ||
+          header.count > (bytes - offset) / sizeof(T)) {
+        munmap(base, bytes);
+        throw std::runtime_error(path + " does not hold rows of this type");
+      }
+    }
+    MappedResults(const MappedResults &other) = delete;
+    MappedResults &operator=(const MappedResults &other) = delete;
+    MappedResults(MappedResults &&other) noexcept
+        : base(std::exchange(other.base, MAP_FAILED)),
+          bytes(std::exchange(other.bytes, 0)), header(other.header) {
+      other.header.count = 0;
+    }
+    MappedResults &operator=(MappedResults &&other) noexcept {
+      std::swap(base, other.base);
+      std::swap(bytes, other.bytes);
+      std::swap(header, other.header);
+      return *this;
+    }
+    ~MappedResults() {
+      if (base != MAP_FAILED)
+        munmap(base, bytes);
+    }
+    inline const T *data() const {
+      return reinterpret_cast<const T *>(static_cast<const char *>(base) +
+                                         offset);
+    }
+    inline size_t size() const { return header.count; }
+    inline bool empty() const { return header.count == 0; }
+    inline const T *begin() const { return data(); }
+    inline const T *end() const { return data() + header.count; }
+    inline const T &operator[](const size_t &index) const {
+      return data()[index];
+    }
+    inline uint64_t fingerprint() const { return header.fingerprint; }
+    inline uint64_t version() const { return header.version; }
+  };
+
+  // Writes the results over values to path, behind a header that records
+  // the fingerprint of pipeline and version, the caller's version of
+  // the input. The file is written aside and renamed over path, so that
+  // a reader never maps a partial file.
+  template <typename T, typename C>
+  void Persist(Composer<T> &pipeline, const C &values, const string &path,
+               const uint64_t &version) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "persisted rows are written as their raw bytes");
+    auto results = pipeline.ToList(values);
+    char head[MappedResults<T>::offset] = {};
+    ResultsHeader header;
+    std::memcpy(header.magic, MappedResults<T>::magic, sizeof(header.magic));
+    header.format = MappedResults<T>::format;
+    header.rowSize = sizeof(T);
+    header.count = results.size();
+    header.fingerprint = pipeline.Fingerprint();
+    header.version = version;
+    std::memcpy(head, &header, sizeof(header));
+    string aside = path + ".tmp" + to_string(getpid());
+    std::FILE *file = std::fopen(aside.c_str(), "wb");
+    if (file == nullptr)
+      throw std::runtime_error("cannot write " + path);
+    bool written =
+        std::fwrite(head, 1, sizeof(head), file) == sizeof(head) &&
+        std::fwrite(results.data(), sizeof(T), results.size(), file) ==
+            results.size() &&
+        std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(aside.c_str(), path.c_str()) != 0) {
+      std::remove(aside.c_str());
+      throw std::runtime_error("cannot write " + path);
+    }
+  }
+  // Maps the results persisted at path if pipeline wrote them for
+  // this version of the input, and otherwise computes and persists them
+  // first
+  template <typename T, typename C>
+  MappedResults<T> Materialize(Composer<T> &pipeline, const C &values,
+                               const string &path, const uint64_t &version) {
+    try {
+      MappedResults<T> results(path);
+      if (results.fingerprint() == pipeline.Fingerprint() &&
+          results.version() == version)
+        return results;
+    } catch (const std::runtime_error &) {
+    }
+    Persist(pipeline, values, path, version);
+    return MappedResults<T>(path);
+  }
+
+} // namespace Pipeline
+#endif
@@ -0,0 +1,39 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testArithmeticSort() {
+  // the value sorts cover every size the small-sort kernel pads
+  for (size_t rows = 0; rows < 300; ++rows) {
+    vector<int> ints(rows);
+    vector<double> doubles(rows);
+    vector<long long> longs(rows);
+    for (size_t index = 0; index < rows; ++index) {
+      ints[index] = static_cast<int>(rng() % 50) - 25;
+      doubles[index] = static_cast<double>(rng()) / 7 - 1e8;
+      longs[index] = static_cast<long long>(rng()) << (rng() % 32);
+    }
+    Composer<int> ascending;
+    ascending.OrderBy(less<int>());
+    auto expected = ints;
+    sort(expected.begin(), expected.end());
+    CHECK(ascending.ToList(ints) == expected);
+    Composer<double> descending;
+    descending.OrderBy(greater<double>());
+    auto expectedDoubles = doubles;
+    sort(expectedDoubles.begin(), expectedDoubles.end(), greater<double>());
+    CHECK(descending.ToList(doubles) == expectedDoubles);
+    Composer<long long> stable;
+    stable.OrderBy(less<long long>(), SortMode::Stable);
+    auto expectedLongs = longs;
+    sort(expectedLongs.begin(), expectedLongs.end());
+    CHECK(stable.ToList(longs) == expectedLongs);
+  }
+}
+
+int main() {
+  testArithmeticSort();
+  return finish();
+}
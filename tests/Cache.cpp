@@ -0,0 +1,61 @@
+#include "Check.hpp"
+#include <cstdint>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testCache() {
+  size_t calls = 0;
+  Composer<int> doubled;
+  doubled.Select([&calls](const int &x) {
+    ++calls;
+    return x * 2;
+  });
+  doubled.Cache();
+  auto rows = iota(100);
+  CHECK(doubled.ToList(rows) == doubled.ToList(rows) && calls == 100);
+  // rows without std::hash or a plain byte layout are hashed by the caller
+  using Pair = pair<int, int>;
+  calls = 0;
+  Composer<Pair> swapped;
+  swapped.Select([&calls](const Pair &row) {
+    ++calls;
+    return Pair(row.second, row.first);
+  });
+  swapped.Cache([](const Pair &row) -> uint64_t {
+    return hashCombine(hashValue(row.first), hashValue(row.second));
+  });
+  vector<Pair> pairs{{1, 2}, {3, 4}};
+  CHECK(swapped.ToList(pairs) == vector<Pair>({{2, 1}, {4, 3}}));
+  CHECK(swapped.ToList(pairs).size() == 2 && calls == 2);
+  pairs[0].first = 5;
+  CHECK(swapped.ToList(pairs).front() == Pair(2, 5) && calls == 4);
+  // a hasher is used even for rows whose bytes could be hashed, here one
+  // that takes inputs differing in sign for the same
+  calls = 0;
+  Composer<int> magnitudes;
+  magnitudes.Select([&calls](const int &x) {
+    ++calls;
+    return x < 0 ? -x : x;
+  });
+  magnitudes.Cache([](const int &x) { return hashValue(x < 0 ? -x : x); });
+  CHECK(magnitudes.ToList({1, -2}) == vector<int>({1, 2}));
+  CHECK(magnitudes.ToList({-1, 2}) == vector<int>({1, 2}) && calls == 2);
+  // a cell the pipeline never registered still keys the cache, through the
+  // stage that reads it
+  Parameter<size_t> limit(5);
+  Composer<int> first;
+  first.Take(limit).Cache();
+  CHECK(first.ToList(rows) == iota(5));
+  limit.Set(2);
+  CHECK(first.ToList(rows) == iota(2));
+  limit.Set(5);
+  CHECK(first.ToList(rows) == iota(5) && first.Explain().find("cached") !=
+                                              string::npos);
+}
+
+int main() {
+  testCache();
+  return finish();
+}
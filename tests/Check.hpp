@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks shared by the test programs, each of which is one translation unit
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": " #condition              \
+                << std::endl;                                                  \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (false)
+
+// Runs body and checks that it throws E
+#define CHECK_THROWS(E, body)                                                  \
+  do {                                                                         \
+    bool thrown = false;                                                       \
+    try {                                                                      \
+      body;                                                                    \
+    } catch (const E &) {                                                      \
+      thrown = true;                                                           \
+    }                                                                          \
+    CHECK(thrown);                                                             \
+  } while (false)
+
+static std::mt19937 rng(42);
+
+static std::vector<int> iota(const size_t &rows) {
+  std::vector<int> values(rows);
+  for (size_t index = 0; index < rows; ++index)
+    values[index] = static_cast<int>(index);
+  return values;
+}
+
+// A file of the given bytes, removed when the test is done
+struct TempFile {
+  std::string path;
+
+  TempFile(const std::string &bytes) {
+    static size_t count = 0;
+    path = (std::filesystem::temp_directory_path() /
+            ("pipeline_test_" + std::to_string(count++) + ".bin"))
+               .string();
+    FILE *file = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+  }
+  TempFile(const TempFile &) = delete;
+  ~TempFile() { remove(path.c_str()); }
+};
+
+static std::string bytesOf(const std::vector<int> &rows) {
+  return std::string(reinterpret_cast<const char *>(rows.data()),
+                     rows.size() * sizeof(int));
+}
+
+// The actual rows Explain reports for the first stage named stage
+static std::string actualRows(const std::string &plan,
+                              const std::string &stage) {
+  auto line = plan.find("\n" + stage + " ");
+  if (line == std::string::npos)
+    return "";
+  auto end = plan.find('\n', line + 1);
+  auto last = plan.rfind(' ', end);
+  return plan.substr(last + 1, end - last - 1);
+}
+
+// The exit status of a test program, after reporting its failures
+static int finish() {
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "all checks passed" << std::endl;
+  return 0;
+}
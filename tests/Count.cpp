@@ -0,0 +1,36 @@
+#include "Check.hpp"
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testCount() {
+  auto rows = iota(1000);
+  size_t calls = 0;
+  auto counted = [&calls](const int &x) {
+    ++calls;
+    return x % 2 == 0;
+  };
+  // a Take after the last Where stops the scan
+  Composer<int> first;
+  first.Where(counted).Take(1);
+  CHECK(first.Count(rows) == 1 && calls == 1);
+  Composer<int> some;
+  some.Where(counted).Select([](const int &x) { return x; }).Take(10).Take(20);
+  calls = 0;
+  CHECK(some.Count(rows) == 10 && calls == 19);
+  calls = 0;
+  CHECK(some.Any(rows) && calls == 1);
+  Composer<int> none;
+  none.Where(counted).Take(0);
+  CHECK(none.Count(rows) == 0);
+  Composer<int> all;
+  all.Take(100).Where(counted);
+  calls = 0;
+  CHECK(all.Count(rows) == 50 && calls == 100);
+  CHECK(all.Count(Prefetch<int>(rows)) == 50);
+}
+
+int main() {
+  testCount();
+  return finish();
+}
@@ -0,0 +1,36 @@
+#include "Check.hpp"
+#include <memory>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testExceptions() {
+  Composer<int> throwing;
+  throwing.Select([](const int &x) {
+    if (x == 5)
+      throw runtime_error("five");
+    return x;
+  });
+  // the run stops the source's thread and lets go of its input
+  auto input = make_unique<vector<int>>(1 << 20, 1);
+  (*input)[5] = 5;
+  CHECK_THROWS(runtime_error,
+               throwing.ToList(Prefetch<int>(*input, 1 << 16, 3)));
+  input.reset();
+  CHECK(throwing.ToList({1, 2, 3}) == vector<int>({1, 2, 3}));
+  CHECK_THROWS(runtime_error, throwing.ToListMany(vector<vector<int>>{{1}, {5}}));
+  CHECK(throwing.Count(vector<int>{1, 2}) == 2);
+  // a throwing sink leaves the pipeline usable
+  Composer<int> sorted;
+  sorted.OrderBy(less<int>());
+  CHECK_THROWS(runtime_error, sorted.ForEach(vector<int>{3, 1, 2}, [](int &) {
+    throw runtime_error("sink");
+  }));
+  CHECK(sorted.ToList({3, 1, 2}) == vector<int>({1, 2, 3}));
+}
+
+int main() {
+  testExceptions();
+  return finish();
+}
@@ -0,0 +1,50 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testIncremental() {
+  size_t calls = 0;
+  auto counted = [&calls](const int &x, const int &y) {
+    ++calls;
+    return x < y;
+  };
+  for (size_t rows : {0, 1, 2, 17, 1000}) {
+    vector<int> values(rows);
+    for (auto &value : values)
+      value = static_cast<int>(rng() % 100);
+    auto sorted = values;
+    sort(sorted.begin(), sorted.end());
+    // read in full, it sorts as any other mode
+    Composer<int> all;
+    all.OrderBy(counted, SortMode::Incremental);
+    CHECK(all.ToList(values) == sorted);
+    CHECK(all.ToList(sorted) == sorted);
+    for (size_t k : {0, 1, 5, 16, 17, 100}) {
+      Composer<int> first;
+      first.OrderBy(counted, SortMode::Incremental).Take(k);
+      CHECK(first.ToList(values) ==
+            vector<int>(sorted.begin(),
+                        sorted.begin() + min(k, sorted.size())));
+    }
+  }
+  // the first few rows of a large input cost a few comparisons per row,
+  // rather than the log2 of the rows that a full sort costs
+  vector<int> values(100000);
+  for (auto &value : values)
+    value = static_cast<int>(rng());
+  auto sorted = values;
+  sort(sorted.begin(), sorted.end());
+  Composer<int> first;
+  first.OrderBy(counted, SortMode::Incremental).Take(10);
+  calls = 0;
+  CHECK(first.ToList(values) ==
+        vector<int>(sorted.begin(), sorted.begin() + 10));
+  CHECK(calls < 5 * values.size());
+}
+
+int main() {
+  testIncremental();
+  return finish();
+}
@@ -0,0 +1,72 @@
+#include "Check.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+// A key whose hashes collide for every other value
+struct Key {
+  int value;
+  bool operator==(const Key &other) const { return value == other.value; }
+};
+
+namespace std {
+template <> struct hash<Key> {
+  size_t operator()(const Key &key) const { return key.value % 2; }
+};
+} // namespace std
+
+// The rows whose key lies in [lowest, highest], in container order
+static vector<int> scan(const vector<int> &rows, const int &lowest,
+                        const int &highest) {
+  vector<int> found;
+  for (auto &row : rows)
+    if (row % 50 >= lowest && row % 50 <= highest)
+      found.push_back(row);
+  return found;
+}
+
+static void testIndex() {
+  Composer<int> identity;
+  identity.Select([](const int &x) { return x; });
+  vector<int> rows(2000);
+  for (auto &value : rows)
+    value = static_cast<int>(rng() % 1000);
+  auto remainder = [](const int &x) { return x % 50; };
+  Index<int, int> sorted(rows, remainder);
+  CHECK(identity.ToList(sorted.Equal(7)) == scan(rows, 7, 7));
+  CHECK(identity.ToList(sorted.Equal(50)).empty());
+  CHECK(identity.ToList(sorted.Range(10, 20)) == scan(rows, 10, 20));
+  CHECK(identity.ToList(sorted.Range(-5, 100)) == rows);
+  // an inverted range is empty
+  CHECK(identity.ToList(sorted.Range(20, 10)).empty());
+  CHECK(sorted.Range(20, 10).size() == 0);
+  // a hash index tells apart keys whose hashes collide
+  vector<Key> keys;
+  for (auto &row : rows)
+    keys.push_back({row % 50});
+  Index<Key, Key, IndexKind::Hash> hashed(
+      keys, [](const Key &key) { return key; });
+  auto sevens = hashed.Equal({7});
+  CHECK(sevens.size() == scan(rows, 7, 7).size());
+  Composer<Key> keyed;
+  keyed.Select([](const Key &key) { return key; });
+  for (auto &key : keyed.ToList(sevens))
+    CHECK(key.value == 7);
+  CHECK(hashed.Equal({51}).size() == 0);
+  Index<int, int, IndexKind::Hash> plain(rows, remainder);
+  CHECK(identity.ToList(plain.Equal(7)) == scan(rows, 7, 7));
+  // after the container changes, a rebuilt index finds the new rows
+  rows.assign({57, 7, 3, 107});
+  sorted.Rebuild();
+  plain.Rebuild();
+  CHECK(identity.ToList(sorted.Equal(7)) == vector<int>({57, 7, 107}));
+  CHECK(identity.ToList(sorted.Range(0, 5)) == vector<int>({3}));
+  CHECK(identity.ToList(plain.Equal(7)) == vector<int>({57, 7, 107}));
+}
+
+int main() {
+  testIndex();
+  return finish();
+}
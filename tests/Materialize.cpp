@@ -0,0 +1,34 @@
+#include "Check.hpp"
+#include "PipelinePersist.hpp"
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+#if defined(PIPELINE_MMAP)
+static void testMaterialize() {
+  auto rows = iota(1000);
+  Composer<int> thirds, fifths;
+  thirds.Where([](const int &x) { return x % 3 == 0; });
+  fifths.Where([](const int &x) { return x % 5 == 0; });
+  CHECK(thirds.Fingerprint() != fifths.Fingerprint());
+  CHECK(thirds.Fingerprint() == Composer<int>(thirds).Fingerprint());
+  // results persisted by one pipeline are not taken for another's
+  TempFile file("");
+  auto persisted = Materialize(thirds, rows, file.path, 7);
+  CHECK(persisted.size() == 334);
+  auto recomputed = Materialize(fifths, rows, file.path, 7);
+  CHECK(vector<int>(recomputed.begin(), recomputed.end()) ==
+        fifths.ToList(rows));
+  Composer<int> ascending, descending;
+  ascending.OrderBy(less<int>());
+  descending.OrderBy(greater<int>());
+  CHECK(ascending.Fingerprint() != descending.Fingerprint());
+}
+#endif
+
+int main() {
+#if defined(PIPELINE_MMAP)
+  testMaterialize();
+#endif
+  return finish();
+}
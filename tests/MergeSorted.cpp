@@ -0,0 +1,63 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+using Row = pair<int, int>;
+
+static bool byValue(const Row &x, const Row &y) { return x.first < y.first; }
+
+// k sorted inputs of random lengths, some of them empty, whose rows are
+// tagged with their input so that the order of ties shows
+static vector<vector<Row>> inputs(const size_t &k) {
+  vector<vector<Row>> values(k);
+  for (size_t input = 0; input < k; ++input) {
+    values[input].resize(rng() % 3 == 0 ? 0 : rng() % 200);
+    for (auto &row : values[input])
+      row = {static_cast<int>(rng() % 50), static_cast<int>(input)};
+    sort(values[input].begin(), values[input].end());
+  }
+  return values;
+}
+
+static void testMergeSorted() {
+  Composer<Row> identity;
+  identity.Select([](const Row &row) { return row; });
+  for (size_t k : {0, 1, 2, 3, 5})
+    for (size_t round = 0; round < 10; ++round) {
+      auto values = inputs(k);
+      // ties come in the order of their inputs, as in a stable sort of the
+      // inputs one after the other
+      vector<Row> expected;
+      for (auto &input : values)
+        expected.insert(expected.end(), input.begin(), input.end());
+      stable_sort(expected.begin(), expected.end(), byValue);
+      CHECK(identity.ToList(MergeSorted<Row>(values, byValue)) == expected);
+      // source stages merge alike, nested merges among them
+      vector<Iterate<Row>> stages;
+      for (auto &input : values)
+        stages.emplace_back(input);
+      CHECK(identity.ToList(MergeSorted<Row>(stages, byValue)) == expected);
+      vector<vector<Row>> lower(values.begin(),
+                                values.begin() + values.size() / 2),
+          upper(values.begin() + values.size() / 2, values.end());
+      vector<MergeSorted<Row>> halves{MergeSorted<Row>(lower, byValue),
+                                      MergeSorted<Row>(upper, byValue)};
+      CHECK(identity.ToList(MergeSorted<Row>(halves, byValue)) == expected);
+    }
+  // a merge of empty inputs is empty, and stopping early is fine
+  vector<vector<Row>> empty(3);
+  CHECK(identity.ToList(MergeSorted<Row>(empty, byValue)).empty());
+  Composer<Row> first;
+  first.Take(2);
+  vector<vector<Row>> two{{{1, 0}, {3, 0}}, {{1, 1}, {2, 1}}};
+  CHECK(first.ToList(MergeSorted<Row>(two, byValue)) ==
+        vector<Row>({{1, 0}, {1, 1}}));
+}
+
+int main() {
+  testMergeSorted();
+  return finish();
+}
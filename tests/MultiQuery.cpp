@@ -0,0 +1,131 @@
+#include "Check.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testMultiQuery() {
+  auto rows = iota(10000);
+  Composer<int> even, odd;
+  even.Where([](const int &x) { return x % 2 == 0; });
+  odd.Where([](const int &x) { return x % 2 == 1; });
+  // pipelines without stages, first and in between
+  MultiQuery<int> query(64);
+  query.Add(Composer<int>()).Add(even).Add(Composer<int>()).Add(odd);
+  auto results = query.ToList(rows);
+  CHECK(results.size() == 4);
+  CHECK(results[0] == rows && results[2] == rows);
+  CHECK(results[1] == even.ToList(rows) && results[3] == odd.ToList(rows));
+  CHECK(MultiQuery<int>().ToList(rows).empty());
+  // forks of one pipeline share their prefix, which runs once
+  Composer<int> base;
+  atomic<size_t> calls(0);
+  base.Select([&calls](const int &x) {
+    ++calls;
+    return x * 3;
+  });
+  Composer<int> small = base, large = base;
+  small.Take(10);
+  large.Where([](const int &x) { return x > 20000; });
+  MultiQuery<int> forks(100, 2);
+  forks.Add(small).Add(large).Add(base);
+  results = forks.ToList(rows);
+  CHECK(calls == rows.size());
+  // every fork reports the rows of the prefix it shared
+  for (size_t index = 0; index < 3; ++index)
+    CHECK(actualRows(forks[index].Explain(), "Select") == "10000");
+  CHECK(results[0] == small.ToList(rows) && results[1] == large.ToList(rows) &&
+        results[2] == base.ToList(rows));
+  // an exception in one pipeline is rethrown once every pipeline stopped
+  Composer<int> failing;
+  failing.Select([](const int &x) {
+    if (x == 5000)
+      throw runtime_error("pipeline");
+    return x;
+  });
+  MultiQuery<int> broken(16, 2);
+  broken.Add(even).Add(failing);
+  CHECK_THROWS(runtime_error, broken.ToList(rows));
+  CHECK(broken.ToList(iota(10))[1] == iota(10));
+  // the pipelines share a few workers; the sorting ones run their sort on
+  // their worker once the scan has ended
+  vector<Composer<int>> mixed;
+  for (int modulus = 1; modulus <= 12; ++modulus) {
+    Composer<int> pipeline;
+    pipeline.Where([modulus](const int &x) { return x % modulus == 0; });
+    if (modulus % 4 == 0)
+      pipeline.OrderBy(greater<int>());
+    if (modulus % 3 == 0)
+      pipeline.Take(modulus * 10);
+    mixed.push_back(pipeline);
+  }
+  for (size_t threads : {1, 2, 5}) {
+    MultiQuery<int> pool(mixed, 100, 3, threads);
+    pool.Add(Composer<int>()).Add(failing);
+    CHECK_THROWS(runtime_error, pool.ToList(rows));
+    MultiQuery<int> healthy(mixed, 100, 3, threads);
+    healthy.Add(Composer<int>());
+    results = healthy.ToList(rows);
+    for (size_t index = 0; index < mixed.size(); ++index)
+      CHECK(results[index] == mixed[index].ToList(rows));
+    CHECK(results.back() == rows);
+    CHECK(actualRows(healthy[1].Explain(), "Where") == "5000");
+    // a Take that is satisfied early stops its pipeline at once
+    Composer<int> few;
+    few.Take(3);
+    MultiQuery<int> short_(100, 3, threads);
+    short_.Add(few).Add(few).Add(even);
+    results = short_.ToList(Prefetch<int>(rows, 100));
+    CHECK(results[0] == iota(3) && results[1] == iota(3) &&
+          results[2] == even.ToList(rows));
+  }
+  // with one thread, every stage of every pipeline runs on the calling
+  // thread, the sorts and the stages past them too
+  auto caller = this_thread::get_id();
+  atomic<size_t> elsewhere(0);
+  auto here = [caller, &elsewhere]() {
+    elsewhere += this_thread::get_id() != caller;
+  };
+  Composer<int> sorted;
+  sorted.Where([here](const int &x) {
+    here();
+    return x % 3 == 0;
+  });
+  sorted.OrderBy([here](const int &x, const int &y) {
+    here();
+    return x > y;
+  });
+  sorted.Select([here](const int &x) {
+    here();
+    return x + 1;
+  });
+  Composer<int> resorted = sorted;
+  resorted.OrderBy([here](const int &x, const int &y) {
+    here();
+    return x < y;
+  });
+  MultiQuery<int> single(100, 3, 1);
+  single.Add(sorted).Add(resorted).Add(even);
+  results = single.ToList(rows);
+  CHECK(elsewhere == 0);
+  CHECK(results[0] == sorted.ToList(rows) &&
+        results[1] == resorted.ToList(rows) &&
+        results[2] == even.ToList(rows));
+  CHECK(single[0].Explain().find("1 threads") != string::npos);
+  // a sort past a Take sees only the rows the Take let through
+  Composer<int> topTen;
+  topTen.Take(10).OrderBy(greater<int>());
+  MultiQuery<int> taken(100, 3, 2);
+  taken.Add(topTen).Add(sorted);
+  results = taken.ToList(rows);
+  CHECK(results[0] == topTen.ToList(rows) &&
+        results[1] == sorted.ToList(rows));
+}
+
+int main() {
+  testMultiQuery();
+  return finish();
+}
@@ -0,0 +1,58 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static bool counting(const Composer<int> &pipeline) {
+  return pipeline.Explain().find("(counting)") != string::npos;
+}
+
+static void testOrderByKey() {
+  vector<int> rows(5000);
+  for (auto &value : rows)
+    value = static_cast<int>(rng() % 2000) - 1000;
+  // keys of a small range, negative ones among them, are counted; rows of
+  // equal keys keep their input order
+  auto byTens = [](const int &x) -> long long { return x / 10; };
+  auto expected = rows;
+  stable_sort(expected.begin(), expected.end(),
+              [&byTens](const int &x, const int &y) {
+                return byTens(x) < byTens(y);
+              });
+  Composer<int> counted;
+  counted.OrderByKey(byTens);
+  CHECK(counted.ToList(rows) == expected && counting(counted));
+  Composer<int> hinted;
+  hinted.OrderByKey(byTens, -100, 100);
+  CHECK(hinted.ToList(rows) == expected && counting(hinted));
+  // keys spread far wider than the input fall back to a comparison sort
+  auto spread = [](const int &x) -> long long { return x * 1000000000LL; };
+  Composer<int> compared;
+  compared.OrderByKey(spread);
+  auto sorted = rows;
+  stable_sort(sorted.begin(), sorted.end());
+  CHECK(compared.ToList(rows) == sorted && !counting(compared));
+  // a hint that some keys fall outside of is not trusted
+  Composer<int> violated;
+  violated.OrderByKey(byTens, 0, 50);
+  CHECK(violated.ToList(rows) == expected && !counting(violated));
+  Composer<int> inverted;
+  inverted.OrderByKey(byTens, 10, -10);
+  CHECK(inverted.ToList(rows) == expected && !counting(inverted));
+  // the widest hint, whose range does not fit a long long, is costed
+  // without overflowing
+  Composer<int> widest;
+  widest.OrderByKey(byTens, LLONG_MIN, LLONG_MAX);
+  CHECK(widest.ToList(rows) == expected && !counting(widest));
+  CHECK(widest.Explain(ExplainFormat::Json).find("OrderByKey") !=
+        string::npos);
+  CHECK(counted.ToList(vector<int>()).empty());
+}
+
+int main() {
+  testOrderByKey();
+  return finish();
+}
@@ -0,0 +1,72 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+// Strings of the bytes 0, 1, 'a' and 0xFF, all starting with prefix
+static vector<string> strings(const size_t &rows, const string &prefix) {
+  const char alphabet[] = {'\0', '\1', 'a', '\xFF'};
+  vector<string> values(rows, prefix);
+  for (auto &value : values)
+    for (size_t length = rng() % 6; length > 0; --length)
+      value += alphabet[rng() % 4];
+  return values;
+}
+
+static void testOrderByNormalized() {
+  // below 256 rows the prefixes are compared, from 256 on radix sorted;
+  // the long common prefix makes every key tie on its first eight bytes
+  for (size_t rows : {0, 1, 100, 255, 256, 3000})
+    for (const string prefix : {"", "abcdefghij"}) {
+      auto values = strings(rows, prefix);
+      Composer<string> ascending, descending;
+      ascending.OrderByNormalized(
+          [](const string &row, SortKey &key) { key.Add(row); });
+      descending.OrderByNormalized(
+          [](const string &row, SortKey &key) { key.Add(row, true); });
+      auto expected = values;
+      sort(expected.begin(), expected.end());
+      CHECK(ascending.ToList(values) == expected);
+      reverse(expected.begin(), expected.end());
+      CHECK(descending.ToList(values) == expected);
+    }
+  // -0.0 and 0.0 are equal keys, so they keep their input order
+  vector<double> doubles{0.0, -0.0, 1.5, -INFINITY, -0.0, 0.0, -2.25, INFINITY};
+  Composer<double> numbers;
+  numbers.OrderByNormalized(
+      [](const double &row, SortKey &key) { key.Add(row); });
+  auto sorted = numbers.ToList(doubles);
+  CHECK(sorted == vector<double>({-INFINITY, -2.25, 0.0, -0.0, -0.0, 0.0,
+                                  1.5, INFINITY}));
+  CHECK(!signbit(sorted[2]) && signbit(sorted[3]) && signbit(sorted[4]) &&
+        !signbit(sorted[5]));
+  // fields compare one after the other, a boolean among them, and rows of
+  // equal keys keep their input order on both paths
+  for (size_t rows : {100, 1000}) {
+    vector<pair<int, int>> pairs(rows);
+    for (size_t index = 0; index < rows; ++index)
+      pairs[index] = {static_cast<int>(rng() % 20) - 10,
+                      static_cast<int>(index)};
+    Composer<pair<int, int>> fields;
+    fields.OrderByNormalized(
+        [](const pair<int, int> &row, SortKey &key) {
+          key.Add(row.first % 2 == 0).Add(row.first, true);
+        });
+    auto expected = pairs;
+    stable_sort(expected.begin(), expected.end(),
+                [](const pair<int, int> &x, const pair<int, int> &y) {
+                  bool xEven = x.first % 2 == 0, yEven = y.first % 2 == 0;
+                  return xEven != yEven ? yEven : x.first > y.first;
+                });
+    CHECK(fields.ToList(pairs) == expected);
+  }
+}
+
+int main() {
+  testOrderByNormalized();
+  return finish();
+}
@@ -0,0 +1,40 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testParallelSort() {
+  vector<int> rows(50000);
+  for (auto &value : rows)
+    value = static_cast<int>(rng() % 1000);
+  auto expected = rows;
+  stable_sort(expected.begin(), expected.end(),
+              [](const int &x, const int &y) { return x / 10 < y / 10; });
+  atomic<size_t> calls(0), failAt(0);
+  Composer<int> sorted;
+  sorted.OrderBy(
+      [&calls, &failAt](const int &x, const int &y) {
+        if (++calls == failAt)
+          throw runtime_error("comparer");
+        return x / 10 < y / 10;
+      },
+      SortMode::Stable, 4);
+  CHECK(sorted.ToList(rows) == expected);
+  // a comparer that throws on a worker thread, on the calling thread, or
+  // during the merges fails the run instead of the process
+  for (size_t at : {10, 100000, 1000000}) {
+    calls = 0;
+    failAt = at;
+    CHECK_THROWS(runtime_error, sorted.ToList(rows));
+  }
+  failAt = 0;
+  CHECK(sorted.ToList(rows) == expected);
+}
+
+int main() {
+  testParallelSort();
+  return finish();
+}
@@ -0,0 +1,53 @@
+#include "Check.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testParameters() {
+  auto rows = iota(100);
+  Composer<int> first;
+  auto count = first.Param<size_t>("n", 5);
+  auto offset = first.Param<long long>("offset", 0);
+  auto label = first.Param<string>("label", "none");
+  first.Take(count).Select([offset](const int &x) {
+    return x + static_cast<int>(*offset);
+  });
+  CHECK(first.ToList(rows) == iota(5));
+  // values of another arithmetic type are converted
+  first.Set("n", 3).Set("offset", 1);
+  CHECK(first.ToList(rows) == vector<int>({1, 2, 3}));
+  first.Set("n", 2.0).Set("label", "two");
+  CHECK(first.ToList(rows).size() == 2 && *label == "two");
+  CHECK_THROWS(out_of_range, first.Set("n", -1));
+  CHECK_THROWS(out_of_range, first.Set("n", -1.0));
+  CHECK_THROWS(out_of_range, first.Set("n", 2.5));
+  CHECK_THROWS(invalid_argument, first.Set("n", string("x")));
+  CHECK_THROWS(invalid_argument, first.Set("label", 1));
+  CHECK_THROWS(out_of_range, first.Set("missing", 1));
+  CHECK(*count == 2);
+  // a copy shares the cells of the original
+  Composer<int> copy = first;
+  copy.Set("n", 4);
+  CHECK(first.ToList(rows).size() == 4);
+  auto bound = first.Bind(rows);
+  bound.Set("n", 1);
+  CHECK(bound.ToList() == vector<int>({1}));
+  CHECK(first.ToList(rows).size() == 1);
+  // appending a copy shares its cells, while another pipeline's cell under
+  // the same name is refused, leaving the pipeline as it was
+  first.append(copy);
+  CHECK(first.ToList(rows).size() == 1);
+  Composer<int> other;
+  other.Param<size_t>("n", 7);
+  other.Take(other.Param<size_t>("n"));
+  CHECK_THROWS(invalid_argument, first.append(other));
+  first.Set("n", 3);
+  CHECK(first.ToList(rows).size() == 3);
+}
+
+int main() {
+  testParameters();
+  return finish();
+}
@@ -0,0 +1,65 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <forward_list>
+#include <list>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testPositional() {
+  auto rows = iota(100);
+  list<int> linked(rows.begin(), rows.end());
+  forward_list<int> single(rows.begin(), rows.end());
+  size_t calls = 0;
+  // Select and Take map row i to row i, so only the rows returned are read
+  Composer<int> direct;
+  direct.Select([&calls](const int &x) {
+    ++calls;
+    return x * 2;
+  });
+  direct.Take(50);
+  auto expected = direct.ToList(rows);
+  reverse(expected.begin(), expected.end());
+  calls = 0;
+  CHECK(direct.Reverse(rows) == expected && calls == 50);
+  calls = 0;
+  CHECK(direct.Last(rows) == 98 && calls == 1);
+  calls = 0;
+  CHECK(direct.ElementAt(rows, 7) == 14 && calls == 1);
+  calls = 0;
+  CHECK(direct.Reverse(linked) == expected && direct.Last(linked) == 98 &&
+        direct.ElementAt(linked, 49) == 98 && calls == 52);
+  // a container without bidirectional iterators is run in full
+  calls = 0;
+  CHECK(direct.Reverse(single) == expected && calls == 50);
+  calls = 0;
+  CHECK(direct.Last(single) == 98 && calls == 50);
+  CHECK(direct.ElementAt(single, 3) == 6);
+  // so is a pipeline with a Where, which does not map positions
+  Composer<int> filtered;
+  filtered.Where([](const int &x) { return x % 3 == 0; });
+  auto thirds = filtered.ToList(rows);
+  reverse(thirds.begin(), thirds.end());
+  CHECK(filtered.Reverse(rows) == thirds && filtered.Last(rows) == 99 &&
+        filtered.ElementAt(rows, 2) == 6);
+  CHECK(filtered.Reverse(linked) == thirds &&
+        filtered.ElementAt(single, 33) == 99);
+  // no row to return is out_of_range on every path
+  Composer<int> none;
+  none.Take(0);
+  CHECK(none.Reverse(rows).empty());
+  CHECK_THROWS(out_of_range, none.Last(rows));
+  CHECK_THROWS(out_of_range, direct.Last(vector<int>()));
+  CHECK_THROWS(out_of_range, direct.ElementAt(rows, 50));
+  CHECK_THROWS(out_of_range, direct.ElementAt(linked, 50));
+  CHECK_THROWS(out_of_range, direct.ElementAt(single, 50));
+  CHECK_THROWS(out_of_range, filtered.ElementAt(rows, 34));
+  CHECK_THROWS(out_of_range, filtered.Last(forward_list<int>{1, 2}));
+  CHECK_THROWS(out_of_range, filtered.Last(list<int>()));
+}
+
+int main() {
+  testPositional();
+  return finish();
+}
@@ -0,0 +1,32 @@
+#include "Check.hpp"
+#include <memory>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testPrefetch() {
+  Composer<int> identity;
+  identity.Select([](const int &x) { return x; });
+  auto rows = iota(10000);
+  CHECK(identity.ToList(Prefetch<int>(rows, 7, 2)) == rows);
+  CHECK(identity.ToList(Prefetch<int>(vector<int>(), 7, 2)).empty());
+  // stopping early stops the thread while it waits for a free block
+  Composer<int> first;
+  first.Take(5);
+  CHECK(first.ToList(Prefetch<int>(rows, 16, 2)) == iota(5));
+  CHECK(first.Count(Prefetch<int>(rows, 16, 2)) == 5);
+  // an exception on the thread is rethrown on the reader's
+  size_t generated = 0;
+  Generate<int> failing([&generated]() -> unique_ptr<int> {
+    if (generated == 100)
+      throw runtime_error("source");
+    return make_unique<int>(static_cast<int>(generated++));
+  });
+  CHECK_THROWS(runtime_error, identity.ToList(Prefetch<int>(failing, 16, 3)));
+}
+
+int main() {
+  testPrefetch();
+  return finish();
+}
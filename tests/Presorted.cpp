@@ -0,0 +1,100 @@
+#include "Check.hpp"
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static size_t compared = 0;
+
+static bool ascending(const int &x, const int &y) {
+  ++compared;
+  return x < y;
+}
+static bool descending(const int &x, const int &y) { return x > y; }
+
+static bool passedThrough(const Composer<int> &pipeline) {
+  return pipeline.Explain().find("input already ordered") != string::npos;
+}
+
+static void testPresorted() {
+  vector<int> rows(1000);
+  for (auto &value : rows)
+    value = static_cast<int>(rng() % 500);
+  auto sorted = rows;
+  sort(sorted.begin(), sorted.end());
+  // comparers of one empty type, or one function, agree, and a Where
+  // between them keeps the order
+  auto byValue = [](const int &x, const int &y) { return x < y; };
+  Composer<int> lambdas;
+  lambdas.OrderBy(byValue).Where([](const int &x) { return x % 2 == 0; });
+  lambdas.OrderBy(byValue);
+  auto even = lambdas.ToList(rows);
+  CHECK(is_sorted(even.begin(), even.end()) && passedThrough(lambdas));
+  Composer<int> pointers;
+  pointers.OrderBy(ascending).Take(100).OrderBy(ascending);
+  CHECK(pointers.ToList(rows) ==
+            vector<int>(sorted.begin(), sorted.begin() + 100) &&
+        passedThrough(pointers));
+  // other comparers sort again
+  Composer<int> reversed;
+  reversed.OrderBy(ascending).OrderBy(descending);
+  auto expected = sorted;
+  reverse(expected.begin(), expected.end());
+  CHECK(reversed.ToList(rows) == expected && !passedThrough(reversed));
+  Composer<int> types;
+  types.OrderBy(less<int>()).OrderBy(greater<int>());
+  CHECK(types.ToList(rows) == expected && !passedThrough(types));
+  // one lambda type capturing different values orders differently
+  auto byRemainder = [](const int &modulus) {
+    return [modulus](const int &x, const int &y) {
+      return x % modulus < y % modulus;
+    };
+  };
+  Composer<int> captures;
+  captures.OrderBy(byRemainder(3), SortMode::Stable)
+      .OrderBy(byRemainder(5), SortMode::Stable);
+  expected = rows;
+  stable_sort(expected.begin(), expected.end(), byRemainder(3));
+  stable_sort(expected.begin(), expected.end(), byRemainder(5));
+  CHECK(captures.ToList(rows) == expected && !passedThrough(captures));
+  // a merge of sorted inputs is ordered by its comparer, so the rows are
+  // compared by the merge alone: one comparison per row for two inputs
+  vector<vector<int>> halves{vector<int>(sorted.begin(), sorted.begin() + 500),
+                             vector<int>(sorted.begin() + 500, sorted.end())};
+  Composer<int> merged;
+  merged.OrderBy(ascending);
+  compared = 0;
+  CHECK(merged.ToList(MergeSorted<int>(halves, ascending)) == sorted &&
+        compared <= sorted.size());
+  // input in order, or in a few runs, costs about one comparison per row
+  // and a merge per level
+  size_t calls = 0;
+  Composer<int> counted;
+  counted.OrderBy([&calls](const int &x, const int &y) {
+    ++calls;
+    return x < y;
+  });
+  CHECK(counted.ToList(sorted) == sorted && calls == sorted.size() - 1);
+  auto runs = sorted;
+  rotate(runs.begin(), runs.begin() + 300, runs.end());
+  calls = 0;
+  CHECK(counted.ToList(runs) == sorted && calls < 2 * sorted.size());
+  vector<int> blocks;
+  for (size_t block = 0; block < 4; ++block)
+    blocks.insert(blocks.end(), sorted.begin(), sorted.begin() + 250);
+  auto expectedBlocks = blocks;
+  sort(expectedBlocks.begin(), expectedBlocks.end());
+  calls = 0;
+  CHECK(counted.ToList(blocks) == expectedBlocks &&
+        calls < 3 * blocks.size());
+  calls = 0;
+  CHECK(counted.ToList(rows) == sorted && calls > 3 * rows.size());
+}
+
+int main() {
+  testPresorted();
+  return finish();
+}
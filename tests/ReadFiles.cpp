@@ -0,0 +1,53 @@
+#include "Check.hpp"
+#include "PipelineFiles.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testReadFiles() {
+  Composer<int> identity;
+  identity.Select([](const int &x) { return x; });
+  // empty files, alone and between others
+  TempFile empty("");
+  CHECK(identity.ToList(ReadFiles<int>({empty.path})).empty());
+  auto rows = iota(1000);
+  TempFile full(bytesOf(rows));
+  CHECK(identity.ToList(ReadFiles<int>({empty.path, full.path, empty.path})) ==
+        rows);
+  // a trailing partial row is skipped, as is a file shorter than a row
+  TempFile partial(bytesOf(rows) + "xy");
+  TempFile tiny("abc");
+  CHECK(identity.ToList(ReadFiles<int>({partial.path, tiny.path}, 64, 2)) ==
+        rows);
+  // files of random sizes read through blocks that do not divide them
+  for (size_t round = 0; round < 20; ++round) {
+    vector<int> expected;
+    vector<unique_ptr<TempFile>> files;
+    vector<string> paths;
+    for (size_t index = rng() % 5; index > 0; --index) {
+      vector<int> content(rng() % 3000);
+      for (auto &value : content)
+        value = static_cast<int>(rng());
+      expected.insert(expected.end(), content.begin(), content.end());
+      files.push_back(make_unique<TempFile>(bytesOf(content)));
+      paths.push_back(files.back()->path);
+    }
+    CHECK(identity.ToList(ReadFiles<int>(paths, 4 + rng() % 5000,
+                                         1 + rng() % 6)) == expected);
+  }
+  // stopping early closes the files
+  Composer<int> first;
+  first.Take(3);
+  CHECK(first.ToList(ReadFiles<int>({full.path}, 64)) == vector<int>({0, 1, 2}));
+  CHECK_THROWS(runtime_error,
+               identity.ToList(ReadFiles<int>({full.path + ".missing"})));
+}
+
+int main() {
+  testReadFiles();
+  return finish();
+}
@@ -0,0 +1,42 @@
+#include "Check.hpp"
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testSelectBatch() {
+  vector<size_t> sizes;
+  auto doubled = [&sizes](Span<const int> inputs, Span<int> outputs) {
+    sizes.push_back(inputs.size());
+    for (size_t index = 0; index < inputs.size(); ++index)
+      outputs[index] = inputs[index] * 2;
+  };
+  Composer<int> batched;
+  batched.SelectBatch(doubled, 7);
+  auto rows = iota(100);
+  vector<int> expected(rows.size());
+  for (size_t index = 0; index < rows.size(); ++index)
+    expected[index] = rows[index] * 2;
+  // blocks that do not divide the input leave a short last one
+  CHECK(batched.ToList(rows) == expected);
+  vector<size_t> blocks(14, 7);
+  blocks.push_back(2);
+  CHECK(sizes == blocks);
+  // an input smaller than a block is one block, an empty one none
+  sizes.clear();
+  CHECK(batched.ToList({1, 2, 3}) == vector<int>({2, 4, 6}) &&
+        sizes == vector<size_t>({3}));
+  sizes.clear();
+  CHECK(batched.ToList(vector<int>()).empty() && sizes.empty());
+  // a Take past it stops reading after the block it is in
+  Composer<int> first;
+  first.SelectBatch(doubled, 7).Take(10);
+  sizes.clear();
+  CHECK(first.ToList(rows) == vector<int>(expected.begin(),
+                                          expected.begin() + 10) &&
+        sizes == vector<size_t>({7, 7}));
+}
+
+int main() {
+  testSelectBatch();
+  return finish();
+}
@@ -0,0 +1,44 @@
+#include "Check.hpp"
+#include <string>
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static bool hits(const Composer<int> &pipeline, const string &count) {
+  return pipeline.Explain().find(count + " hits") != string::npos;
+}
+
+static void testSelectMemo() {
+  size_t calls = 0;
+  auto squared = [&calls](const int &x) {
+    ++calls;
+    return x * x;
+  };
+  // at capacity, the clock hand clears the referenced slots it passes and
+  // evicts the first unreferenced one: 2, then 3, but never 1
+  Composer<int> memo;
+  memo.SelectMemo(squared, 2);
+  CHECK(memo.ToList({1, 2, 1, 3, 1, 2}) ==
+        vector<int>({1, 4, 1, 9, 1, 4}));
+  CHECK(calls == 4 && hits(memo, "2"));
+  // the table is kept across runs
+  calls = 0;
+  CHECK(memo.ToList({2, 1}) == vector<int>({4, 1}) && calls == 0);
+  // with both referenced, a full turn of the hand evicts the first slot
+  CHECK(memo.ToList({3, 2, 1}) == vector<int>({9, 4, 1}) && calls == 2);
+  // a copy starts with an empty table
+  Composer<int> copy = memo;
+  calls = 0;
+  CHECK(copy.ToList({2, 1}) == vector<int>({4, 1}) && calls == 2);
+  // with a capacity of 0 nothing is cached
+  Composer<int> none;
+  none.SelectMemo(squared, 0);
+  calls = 0;
+  CHECK(none.ToList({5, 5, 5}) == vector<int>({25, 25, 25}) && calls == 3 &&
+        hits(none, "0"));
+}
+
+int main() {
+  testSelectMemo();
+  return finish();
+}
@@ -0,0 +1,41 @@
+#include "Check.hpp"
+#include <vector>
+using namespace std;
+using namespace Pipeline;
+
+static void testTee() {
+  auto rows = iota(1000);
+  Composer<int> upstream, even;
+  upstream.Select([](const int &x) { return x + 1; });
+  even.Where([](const int &x) { return x % 2 == 0; });
+  auto shifted = upstream.ToList(rows);
+  // a branch without stages yields the upstream output as it is
+  auto results = upstream.Tee(rows, {Composer<int>()});
+  CHECK(results.size() == 1 && results[0] == shifted);
+  results = upstream.Tee(rows, {even, Composer<int>()});
+  CHECK(results[0] == even.ToList(shifted) && results[1] == shifted);
+  results = Composer<int>().Tee(rows, {Composer<int>(), even});
+  CHECK(results[0] == rows && results[1] == even.ToList(rows));
+  CHECK(upstream.Tee(rows, {}).empty());
+  // branches that are not safe to call concurrently run on the calling
+  // thread by default, and may be spread over threads when they are
+  size_t calls = 0;
+  auto counted = [&calls](const int &x) {
+    ++calls;
+    return x % 3 == 0;
+  };
+  vector<Composer<int>> branches(3);
+  for (auto &branch : branches)
+    branch.Where(counted);
+  results = upstream.Tee(rows, branches);
+  CHECK(calls == 3 * rows.size() &&
+        results[2] == branches[0].ToList(shifted));
+  results = upstream.Tee(rows, {even, Composer<int>(), even}, 3);
+  CHECK(results[0] == even.ToList(shifted) && results[1] == shifted &&
+        results[2] == results[0]);
+}
+
+int main() {
+  testTee();
+  return finish();
+}